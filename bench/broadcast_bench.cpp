@@ -0,0 +1,53 @@
+#include "luapp11/lua.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+using namespace luapp11;
+
+namespace {
+const int states = 8;
+
+template <typename F> double millis(F f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  std::chrono::duration<double, std::milli> ms =
+      std::chrono::steady_clock::now() - start;
+  return ms.count();
+}
+}
+
+int main() {
+  state source;
+  source.do_chunk("config = {} for i = 1, 20000 do config['key' .. i] = "
+                  "{ id = i, enabled = i % 2 == 0, tags = { 'a', 'b' } } end");
+  std::vector<state> targets(states);
+
+  double ms = millis([&]() {
+    for (auto& t : targets) {
+      t["config"].copy_from(source["config"]);
+    }
+  });
+  std::cout << "copy into " << states << " states: " << ms << " ms"
+            << std::endl;
+
+  ms = millis([&]() {
+    broadcast b(source["config"]);
+    for (auto& t : targets) {
+      b.apply(t["config"]);
+    }
+  });
+  std::cout << "broadcast to " << states << " states: " << ms << " ms"
+            << std::endl;
+
+  ms = millis([&]() {
+    broadcast b(source["config"]);
+    for (auto& t : targets) {
+      b.apply(t["config"], broadcast::decode::on_first_field);
+    }
+  });
+  std::cout << "lazy broadcast to " << states << " states: " << ms
+            << " ms, before first use" << std::endl;
+  return 0;
+}
@@ -0,0 +1,71 @@
+#include "luapp11/lua.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+using namespace luapp11;
+
+namespace {
+const char* small = "msg = { id = 1, kind = 'tick', value = 0.5 }";
+const char* large = "msg = {} for i = 1, 1000 do "
+                    "msg[i] = { id = i, name = 'item' .. i } end";
+
+// Messages one way, as fast as they go.
+void throughput(const char* name, const char* make, int count,
+                bool single_producer) {
+  channel ch(1024, single_producer);
+  auto start = std::chrono::steady_clock::now();
+  std::thread producer([&]() {
+    state p;
+    ch.bind(p["ch"]);
+    p.do_chunk(make);
+    p["count"] = count;
+    p.do_chunk("for i = 1, count do ch:send(msg) end");
+  });
+  state c;
+  ch.bind(c["ch"]);
+  c["count"] = count;
+  c.do_chunk("for i = 1, count do ch:recv() end");
+  producer.join();
+  std::chrono::duration<double> secs =
+      std::chrono::steady_clock::now() - start;
+  std::cout << name << (single_producer ? " spsc" : " mpsc")
+            << " throughput: " << (long long)(count / secs.count())
+            << " messages/s" << std::endl;
+}
+
+// A message there and back, one at a time.
+void latency(const char* name, const char* make, int count) {
+  channel there(16, true), back(16, true);
+  std::thread echo([&]() {
+    state e;
+    there.bind(e["there"]);
+    back.bind(e["back"]);
+    e["count"] = count;
+    e.do_chunk("for i = 1, count do back:send(there:recv()) end");
+  });
+  state s;
+  there.bind(s["there"]);
+  back.bind(s["back"]);
+  s.do_chunk(make);
+  s["count"] = count;
+  auto start = std::chrono::steady_clock::now();
+  s.do_chunk("for i = 1, count do there:send(msg) back:recv() end");
+  std::chrono::duration<double, std::micro> us =
+      std::chrono::steady_clock::now() - start;
+  echo.join();
+  std::cout << name << " round trip: " << us.count() / count << " us"
+            << std::endl;
+}
+}
+
+int main() {
+  throughput("small", small, 200000, false);
+  throughput("small", small, 200000, true);
+  throughput("large", large, 2000, false);
+  latency("small", small, 20000);
+  latency("large", large, 500);
+  return 0;
+}
@@ -0,0 +1,39 @@
+#include "luapp11/lua.hpp"
+
+#include <chrono>
+#include <iostream>
+
+using namespace luapp11;
+
+namespace {
+const int iterations = 200000;
+
+const std::string rule = "local score = 0 "
+                         "if level > 10 then score = score + level * 2 end "
+                         "if name == 'admin' then score = score + 100 end "
+                         "return score";
+
+void run(const std::string& name) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++) {
+    global["score"].do_chunk(rule);
+  }
+  std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+  std::cout << name << ": " << (long long)(iterations / secs.count())
+            << " chunks/s" << std::endl;
+}
+}
+
+int main() {
+  global["level"] = 12;
+  global["name"] = std::string("admin");
+
+  auto& cache = chunk_cache::of(global);
+  cache.set_capacity(0);
+  run("uncached");
+  cache.set_capacity(1 << 20);
+  run("cached");
+  std::cout << "hits: " << cache.hits() << " misses: " << cache.misses()
+            << std::endl;
+  return 0;
+}
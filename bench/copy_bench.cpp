@@ -0,0 +1,43 @@
+#include "luapp11/lua.hpp"
+
+#include <chrono>
+#include <iostream>
+
+using namespace luapp11;
+
+namespace {
+const int values = 100000;
+
+template <typename F> double seconds(F f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+  return secs.count();
+}
+}
+
+int main() {
+  state from, to;
+  from.do_chunk("numbers = {} for i = 1, 100000 do numbers[i] = i * 0.5 end");
+  from.do_chunk("records = {} for i = 1, 100000 do records[i] = "
+                "{ id = i, name = 'user' .. i, tags = { 'a', 'b' } } end");
+
+  // An element at a time through val, the only way before deep copies.
+  double secs = seconds([&]() {
+    to["numbers"] = { 0 };
+    for (int i = 1; i <= values; i++) {
+      to["numbers"][i] = from["numbers"][i];
+    }
+  });
+  std::cout << "numbers through val: " << (long long)(values / secs)
+            << " values/s" << std::endl;
+
+  secs = seconds([&]() { to["numbers"] = from["numbers"]; });
+  std::cout << "numbers deep copied: " << (long long)(values / secs)
+            << " values/s" << std::endl;
+
+  secs = seconds([&]() { to["records"] = from["records"]; });
+  std::cout << "records deep copied: " << (long long)(values / secs)
+            << " records/s" << std::endl;
+  return 0;
+}
@@ -0,0 +1,55 @@
+#include "luapp11/lua.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+using namespace luapp11;
+
+namespace {
+const int entries = 200000;
+const int lookups = 1000000;
+
+const char* lookup = "local t = 0 for i = 1, lookups do "
+                     "t = t + (data['k' .. (i % entries)] or 0) end return t";
+
+double lookups_per_second(state& s) {
+  s["lookups"] = lookups;
+  s["entries"] = entries;
+  auto start = std::chrono::steady_clock::now();
+  s["t"].do_chunk(lookup);
+  std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+  return lookups / secs.count();
+}
+
+double kilobytes(state& s) {
+  s["kb"].do_chunk("collectgarbage() return collectgarbage('count')");
+  return s["kb"].get<double>();
+}
+}
+
+int main() {
+  std::unordered_map<std::string, double> map;
+  for (int i = 0; i < entries; i++) {
+    map["k" + std::to_string(i)] = i;
+  }
+  auto shared = std::make_shared<const std::unordered_map<std::string, double>>(
+      std::move(map));
+
+  state copied;
+  copied["entries"] = entries;
+  copied["data"].do_chunk("local d = {} for i = 0, entries - 1 do "
+                          "d['k' .. i] = i end return d");
+  std::cout << "lua table: " << (long long)lookups_per_second(copied)
+            << " lookups/s, " << (long long)kilobytes(copied)
+            << " KB per state" << std::endl;
+
+  state proxied;
+  dataset::of(shared).bind(proxied["data"]);
+  std::cout << "dataset: " << (long long)lookups_per_second(proxied)
+            << " lookups/s, " << (long long)kilobytes(proxied)
+            << " KB per state" << std::endl;
+  return 0;
+}
@@ -0,0 +1,45 @@
+#include "luapp11/lua.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+using namespace luapp11;
+
+namespace {
+const int jobs = 20000;
+
+void init(state& s) {
+  s.do_chunk("function work(n) local s = 0 for i = 1, n do s = s + i % 7 end "
+             "return s end");
+}
+
+void run(size_t workers) {
+  std::atomic<long long> total { 0 };
+  auto start = std::chrono::steady_clock::now();
+  {
+    executor pool(workers, &init);
+    for (int i = 0; i < jobs; i++) {
+      pool.post<int>([&total](result<int> r) { total += r.value(); }, "work",
+                     1000);
+    }
+    pool.wait();
+    std::chrono::duration<double> secs =
+        std::chrono::steady_clock::now() - start;
+    std::cout << workers << " workers: " << (long long)(jobs / secs.count())
+              << " jobs/s, " << pool.get_stats().stolen << " stolen"
+              << std::endl;
+  }
+}
+}
+
+int main() {
+  size_t cores = std::max(1u, std::thread::hardware_concurrency());
+  for (size_t workers = 1; workers <= std::max<size_t>(cores, 4);
+       workers *= 2) {
+    run(workers);
+  }
+  return 0;
+}
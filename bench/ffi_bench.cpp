@@ -0,0 +1,34 @@
+#include "luapp11/lua.hpp"
+
+#include <chrono>
+#include <iostream>
+
+using namespace luapp11;
+
+namespace {
+const int iterations = 50000000;
+
+int add(int a, int b) { return a + b; }
+
+void run(const std::string& name) {
+  global["bench"].do_chunk("return function(n) local f = " + name +
+                           " local s = 0 for i = 1, n do s = f(i, 1) end "
+                           "return s end");
+  auto start = std::chrono::steady_clock::now();
+  global["bench"].invoke<int>(iterations);
+  std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+  std::cout << name << ": " << (long long)(iterations / secs.count())
+            << " calls/s" << std::endl;
+}
+}
+
+int main() {
+  global["add_fn"] = LUAPP11_FN(add);
+  global["add_ffi"] = LUAPP11_FFI_FN(add);
+
+  // lua_CFunction calls abort the trace, so this loop stays interpreted.
+  run("add_fn");
+  // ffi calls are compiled into the trace.
+  run("add_ffi");
+  return 0;
+}
@@ -0,0 +1,58 @@
+#include "luapp11/lua.hpp"
+
+#include <chrono>
+#include <iostream>
+
+using namespace luapp11;
+
+namespace {
+const int iterations = 10000000;
+
+const std::string loop = "local s = 0 for i = 1, n do s = f(i, 1) end "
+                        "return s end";
+
+int add(int a, int b) { return a + b; }
+
+int raw_add(lua_State* L) {
+  lua_pushnumber(L, lua_tonumber(L, 1) + lua_tonumber(L, 2));
+  return 1;
+}
+
+void report(const std::string& name,
+            std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+  std::cout << name << ": " << (long long)(iterations / secs.count())
+            << " calls/s" << std::endl;
+}
+
+void run(const std::string& name) {
+  global["bench"].do_chunk("return function(n) local f = " + name + " " +
+                           loop);
+  auto start = std::chrono::steady_clock::now();
+  global["bench"].invoke<int>(iterations);
+  report(name, start);
+}
+
+void run_raw() {
+  lua_State* L = luaL_newstate();
+  luaL_openlibs(L);
+  luaL_loadstring(L, ("return function(f, n) " + loop).c_str());
+  lua_call(L, 0, 1);
+  lua_pushcfunction(L, &raw_add);
+  lua_pushnumber(L, iterations);
+  auto start = std::chrono::steady_clock::now();
+  lua_call(L, 2, 1);
+  report("raw", start);
+  lua_close(L);
+}
+}
+
+int main() {
+  global["add_ptr"] = &add;
+  global["add_fn"] = LUAPP11_FN(add);
+
+  run_raw();
+  run("add_ptr");
+  run("add_fn");
+  return 0;
+}
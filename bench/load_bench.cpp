@@ -0,0 +1,46 @@
+#include "luapp11/lua.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+using namespace luapp11;
+
+namespace {
+const int rows = 250000;
+const std::string path = "/tmp/luapp11_load_bench.lua";
+
+void write_data() {
+  std::ofstream out(path);
+  out << "return {\n";
+  for (int i = 0; i < rows; i++) {
+    out << "  { id = " << i << ", name = \"row" << i << "\", weight = "
+        << i * 0.5 << " },\n";
+  }
+  out << "}\n";
+}
+
+void run(const std::string& name, int (*load)(lua_State*, const char*)) {
+  lua_State* L = luaL_newstate();
+  auto start = std::chrono::steady_clock::now();
+  load(L, path.c_str());
+  std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+  std::cout << name << ": " << secs.count() * 1000 << " ms" << std::endl;
+  lua_close(L);
+}
+
+int whole(lua_State* L, const char* p) { return detail::load_whole(L, p); }
+}
+
+int main() {
+  write_data();
+  std::ifstream in(path, std::ios::ate);
+  std::cout << "compiling " << in.tellg() / (1 << 20) << " MB" << std::endl;
+  run("luaL_loadfile", &luaL_loadfile);
+  run("whole", &whole);
+  run("luaL_loadfile", &luaL_loadfile);
+  run("whole", &whole);
+  std::remove(path.c_str());
+  return 0;
+}
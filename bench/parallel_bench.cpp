@@ -0,0 +1,56 @@
+#include "luapp11/lua.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+using namespace luapp11;
+
+namespace {
+const int values = 1000000;
+
+void init(state& s) {
+  s.do_chunk("function score(x) return (x * 31 + 7) % 1000 end");
+}
+
+template <typename F> double seconds(F f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+  return secs.count();
+}
+}
+
+int main() {
+  std::vector<double> in;
+  for (int i = 0; i < values; i++) {
+    in.push_back(i);
+  }
+
+  state single;
+  init(single);
+  std::vector<double> out;
+  double secs = seconds([&]() {
+    single["score"].invoke_each<double>(in.begin(), in.end(),
+                                        std::back_inserter(out));
+  });
+  std::cout << "invoke_each: " << (long long)(values / secs) << " values/s"
+            << std::endl;
+
+  size_t cores = std::max(1u, std::thread::hardware_concurrency());
+  for (size_t states = 1; states <= std::max<size_t>(cores, 4); states *= 2) {
+    state_pool pool(states, &init);
+    out.clear();
+    secs = seconds([&]() {
+      parallel_map<double>(pool, "score", in.begin(), in.end(),
+                           std::back_inserter(out));
+    });
+    std::cout << "parallel_map, " << states
+              << " states: " << (long long)(values / secs) << " values/s"
+              << std::endl;
+  }
+  return 0;
+}
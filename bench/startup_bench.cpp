@@ -0,0 +1,75 @@
+#include "luapp11/lua.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+using namespace luapp11;
+
+namespace {
+const int scripts = 300;
+const int functions = 100;
+
+std::vector<std::string> write_corpus() {
+  std::vector<std::string> paths;
+  for (int s = 0; s < scripts; s++) {
+    std::string path = "/tmp/luapp11_startup_" + std::to_string(s) + ".lua";
+    std::ofstream out(path);
+    out << "local M = {}\n";
+    for (int f = 0; f < functions; f++) {
+      out << "function M.f" << f << "(a, b)\n"
+          << "  local t = { x = a, y = b, name = 'f" << f << "' }\n"
+          << "  if a > b then return t.x * " << f << " else return t.y end\n"
+          << "end\n";
+    }
+    out << "return M\n";
+    paths.push_back(path);
+  }
+  return paths;
+}
+
+void run(const std::string& name, const std::vector<std::string>& paths) {
+  auto start = std::chrono::steady_clock::now();
+  for (auto& path : paths) {
+    global["module"].do_file(path);
+  }
+  std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+  std::cout << name << ": " << secs.count() * 1000 << " ms for "
+            << paths.size() << " scripts" << std::endl;
+}
+}
+
+int main() {
+  auto paths = write_corpus();
+  run("source", paths);
+
+  for (auto& path : paths) {
+    compile_file(path, path + "c", true);
+  }
+  run("luac", paths);
+
+  auto& store = bytecode_store::of(global);
+  for (auto& path : paths) {
+    std::string bytecode;
+    dump_file(path, bytecode, true);
+    store.add(path, std::move(bytecode));
+  }
+  run("memory", paths);
+
+  for (unsigned threads = 1; threads <= 8; threads *= 2) {
+    auto start = std::chrono::steady_clock::now();
+    store.compile(paths, true, threads);
+    std::chrono::duration<double> secs =
+        std::chrono::steady_clock::now() - start;
+    std::cout << "compile on " << threads << " threads: "
+              << secs.count() * 1000 << " ms" << std::endl;
+  }
+
+  for (auto& path : paths) {
+    std::remove(path.c_str());
+    std::remove((path + "c").c_str());
+  }
+  return 0;
+}
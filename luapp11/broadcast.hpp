@@ -0,0 +1,251 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "luapp11/internal/lazy.hpp"
+#include "luapp11/internal/serialize.hpp"
+
+namespace luapp11 {
+
+/**
+ * A lua value serialized once, to be rebuilt in any number of lua states.  Pushing one large table into every state
+ * of a pool costs one serialization and a fast decode per state, rather than a full conversion per state.
+ *
+ * <pre>
+ *   broadcast config(admin["config"]);
+ *   config.apply(pool, "config");
+ * </pre>
+ *
+ * The serialized buffer is immutable and shared by copies of the broadcast and by states which haven't decoded it
+ * yet, and freed when the last of them is done with it.  Values are serialized as for a channel: tables are copied
+ * with their shared parts and cycles, but not their metatables, and functions, full userdata, and coroutines can't
+ * be broadcast.
+ */
+class broadcast {
+ public:
+  /**
+   * When a table is decoded in a state it's applied to.
+   */
+  enum class decode {
+    // Right away.
+    now,
+    // The first time one of its fields is read or written, so states which never use it never pay to decode it.
+    // Until then it's an empty table to anything which doesn't go through its fields: next, ipairs and the length
+    // operator see nothing, and pairs does too unless LuaJIT honours __pairs.  Only for tables which lua code reads
+    // by key.  Serializing or copying the table from c++ decodes it first, and so does a channel.  Its metatable
+    // is protected until it's decoded, so setmetatable fails rather than dropping the value.
+    on_first_field
+  };
+
+  /**
+   * Serialize a value.  Throws if it can't be serialized.
+   * @param source  The location of the value.
+   */
+  explicit broadcast(const var& source) : data_ { std::make_shared<data>() } {
+    stack_guard g(source.L);
+    source.push();
+    const char* failed = detail::serialize(source.L, -1, data_->bytes);
+    if (failed != nullptr) {
+      throw exception(std::string("Unable to broadcast ") + failed + ".", source.L);
+    }
+    data_->table = lua_istable(source.L, -1);
+  }
+
+  /**
+   * The size of the serialized value in bytes.
+   */
+  size_t size() const { return data_->bytes.size(); }
+
+  /**
+   * The number of times the value has been decoded, across every state it was applied to.
+   */
+  size_t decodes() const { return data_->decodes; }
+
+  /**
+   * Assign the value to a location.
+   * @param target  The location to assign to.
+   * @param when    When to decode a table.  Values other than tables are always decoded now.
+   */
+  void apply(const var& target, decode when = decode::now) const {
+    lua_State* L = target.L;
+    stack_guard g(L);
+    target.push_parent_key();
+    if (when == decode::on_first_field && data_->table) {
+      push_lazy(L);
+    } else {
+      decode(L, 0);
+    }
+    lua_settable(L, target.lineage_.size() == 1 ? target.virtual_index_ : -3);
+  }
+
+  /**
+   * Assign the value to a global in every state of a pool.  Checks out one state at a time, as each comes free, and
+   * uses a state the calling thread already has checked out as it is.
+   * @param pool  The states.
+   * @param name  The name of the global.
+   * @param when  When to decode a table, as for apply(var).
+   */
+  void apply(state_pool& pool, const std::string& name, decode when = decode::now) const {
+    pool.for_each([&](state& s) { apply(s[name], when); });
+  }
+
+ private:
+  struct data {
+    data() : table { false }
+    , decodes { 0 }
+    {}
+
+    std::string bytes;
+    bool table;
+    mutable std::atomic<size_t> decodes;
+  };
+
+  typedef std::shared_ptr<const data> handle;
+
+  // Pushes the value, or with into decodes it into the table there.
+  void decode(lua_State* L, int into) const { decode(L, *data_, into); }
+
+  static void decode(lua_State* L, const data& d, int into) {
+    if (!detail::deserialize(L, d.bytes.data(), d.bytes.size(), into)) {
+      throw exception("Unable to decode broadcast.", L);
+    }
+    d.decodes++;
+  }
+
+  static int collect(lua_State* L) {
+    static_cast<handle*>(lua_touserdata(L, 1))->~handle();
+    return 0;
+  }
+
+  // Fills in a lazy table at index 1, then drops its metatable and with it
+  // the buffer.  Decoding only sets fields raw, so the metatable can stay
+  // until it succeeds.  If it fails, whatever was filled in is cleared again
+  // and the table stays lazy, so later reads fail too rather than see part
+  // of the value.
+  static bool materialize(lua_State* L) {
+    handle h = *static_cast<handle*>(lua_touserdata(L, lua_upvalueindex(1)));
+    int top = lua_gettop(L);
+    try {
+      decode(L, *h, 1);
+    } catch (std::exception&) {
+      lua_settop(L, top);
+      clear(L, 1);
+      return false;
+    }
+    lua_settop(L, top);
+    lua_pushnil(L);
+    lua_setmetatable(L, 1);
+    return true;
+  }
+
+  // Removes every field of the table at an absolute index.
+  static void clear(lua_State* L, int idx) {
+    lua_pushnil(L);
+    while (lua_next(L, idx) != 0) {
+      lua_pop(L, 1);
+      // Clearing a field during traversal is allowed.
+      lua_pushvalue(L, -1);
+      lua_pushnil(L);
+      lua_rawset(L, idx);
+    }
+  }
+
+  static int lazy_fill(lua_State* L) {
+    if (!materialize(L)) {
+      return luaL_error(L, "Unable to decode broadcast.");
+    }
+    return 0;
+  }
+
+  static int lazy_index(lua_State* L) {
+    lazy_fill(L);
+    lua_settop(L, 2);
+    lua_rawget(L, 1);
+    return 1;
+  }
+
+  static int lazy_newindex(lua_State* L) {
+    lazy_fill(L);
+    lua_settop(L, 3);
+    lua_rawset(L, 1);
+    return 0;
+  }
+
+  static int lazy_len(lua_State* L) {
+    lazy_fill(L);
+    lua_pushnumber(L, (lua_Number) lua_objlen(L, 1));
+    return 1;
+  }
+
+  static int lazy_pairs(lua_State* L) {
+    lazy_fill(L);
+    lua_getglobal(L, "next");
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+    return 3;
+  }
+
+  // An empty table sized for the value, with a metatable of its own whose
+  // functions share the buffer.
+  void push_lazy(lua_State* L) const {
+    uint64_t length = 0, hash = 0;
+    peek_sizes(length, hash);
+    lua_createtable(L, (int) length, (int) hash);
+    lua_createtable(L, 0, 6);
+    int meta = lua_gettop(L);
+    new (lua_newuserdata(L, sizeof(handle))) handle(data_);
+    lua_createtable(L, 0, 1);
+    lua_pushcfunction(L, &collect);
+    lua_setfield(L, -2, "__gc");
+    lua_setmetatable(L, -2);
+    int buffer = lua_gettop(L);
+    const struct {
+      const char* name;
+      lua_CFunction f;
+    } methods[] = {
+      { "__index", &lazy_index },
+      { "__newindex", &lazy_newindex },
+      { "__len", &lazy_len },
+      { "__pairs", &lazy_pairs },
+      { nullptr, &lazy_fill }
+    };
+    for (auto& m : methods) {
+      if (m.name != nullptr) {
+        lua_pushstring(L, m.name);
+      } else {
+        lua_pushlightuserdata(L, detail::lazy_key());
+      }
+      lua_pushvalue(L, buffer);
+      lua_pushcclosure(L, m.f, 1);
+      lua_rawset(L, meta);
+    }
+    lua_settop(L, meta);
+    lua_pushliteral(L, "broadcast");
+    lua_setfield(L, meta, "__metatable");
+    lua_setmetatable(L, -2);
+  }
+
+  // The array and hash sizes at the start of a serialized table.
+  void peek_sizes(uint64_t& length, uint64_t& hash) const {
+    const std::string& b = data_->bytes;
+    size_t p = 1;
+    for (uint64_t* n : { &length, &hash }) {
+      *n = 0;
+      for (int shift = 0; p < b.size() && shift < 64; shift += 7) {
+        unsigned char c = static_cast<unsigned char>(b[p++]);
+        *n |= (uint64_t)(c & 0x7f) << shift;
+        if ((c & 0x80) == 0) {
+          break;
+        }
+      }
+    }
+  }
+
+  std::shared_ptr<data> data_;
+};
+
+}
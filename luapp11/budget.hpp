@@ -0,0 +1,148 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+#include "luapp11/internal/interpreter.hpp"
+
+namespace luapp11 {
+
+class state;
+
+/**
+ * Limits how long lua code may run.  While a budget is alive every call into its lua state (var::invoke, do_chunk,
+ * do_file, function, ...) is checked every few VM instructions, and stopped with an error once it has run too many
+ * instructions, taken too long, or been cancelled.  The error comes back through the usual result or error, with an
+ * error_type() of error::type::timeout or error::type::cancelled.  pcall inside the script can't swallow it, the next
+ * check raises it again.
+ *
+ * <pre>
+ *   budget b(global, 1000000, std::chrono::milliseconds(50));
+ *   auto r = global["update"].invoke<int>(dt);
+ *   if (r.error().error_type() == error::type::timeout) ...
+ * </pre>
+ *
+ * Hooks don't run inside JIT compiled code, so by default the JIT is flushed and turned off while the budget is
+ * alive, and turned back on once no budget or time slice on the state needs it off, if it was on.  Otherwise a
+ * compiled loop could run past the budget forever.  Budgets nest, only the innermost one is checked.  A budget belongs to the thread which created it, except for cancel().
+ */
+class budget {
+ public:
+  typedef std::chrono::steady_clock clock;
+
+  /**
+   * @param v             Any location in the lua state to limit.
+   * @param instructions  The most lua VM instructions which may run.  0 for no limit.
+   * @param wall_time     The most time which may pass.  0 for no limit.
+   * @param interpret     Turn the JIT off while the budget is alive, so compiled code can't escape it.
+   */
+  budget(const var& v, size_t instructions, clock::duration wall_time = clock::duration::zero(),
+         bool interpret = true) : budget(v.L, instructions, wall_time, interpret)
+  {}
+
+  /**
+   * @param s             The lua state to limit.
+   * @param instructions  The most lua VM instructions which may run.  0 for no limit.
+   * @param wall_time     The most time which may pass.  0 for no limit.
+   * @param interpret     Turn the JIT off while the budget is alive, so compiled code can't escape it.
+   */
+  budget(const state& s, size_t instructions, clock::duration wall_time = clock::duration::zero(),
+         bool interpret = true);
+
+  budget(const budget&) = delete;
+  budget& operator=(const budget&) = delete;
+
+  ~budget() {
+    lua_sethook(L, previous_hook_, previous_mask_, previous_count_);
+    current() = previous_;
+  }
+
+  /**
+   * Stop the lua code running under this budget at its next check.  Safe to call from any thread, e.g. a watchdog.
+   */
+  void cancel() { cancelled_.store(true, std::memory_order_relaxed); }
+
+  /**
+   * Whether the budget has run out or been cancelled.  Nothing more can run while it's alive.
+   */
+  bool expired() const { return expired_ != error::type::none; }
+
+  /**
+   * The number of VM instructions counted so far.  Counted in steps of up to a thousand, so this can be a little
+   * behind.
+   */
+  size_t used() const { return used_; }
+
+  /**
+   * The time since the budget started.
+   */
+  clock::duration elapsed() const { return clock::now() - start_; }
+
+ private:
+  // How often the hook checks the budget when there's no tighter instruction
+  // limit.  Bounds how long cancel() and the wall clock take to notice.
+  static const int check_interval = 1000;
+
+  budget(lua_State* L, size_t instructions, clock::duration wall_time, bool interpret) : L { L }
+  , instructions_ { instructions }
+  , used_ { 0 }
+  , start_ { clock::now() }
+  , wall_time_ { wall_time }
+  , interpret_ { L, interpret }
+  , cancelled_ { false }
+  , expired_ { error::type::none }
+  , previous_ { current() }
+  , previous_hook_ { lua_gethook(L) }
+  , previous_mask_ { lua_gethookmask(L) }
+  , previous_count_ { lua_gethookcount(L) }
+  {
+    step_ = instructions_ != 0 && instructions_ < (size_t) check_interval ? (int) instructions_ : check_interval;
+    current() = this;
+    lua_sethook(L, &hook, LUA_MASKCOUNT, step_);
+  }
+
+  static budget*& current() {
+    static thread_local budget* b = nullptr;
+    return b;
+  }
+
+  static void hook(lua_State* L, lua_Debug*) {
+    budget* b = current();
+    if (b == nullptr) {
+      return;
+    }
+    if (!b->expired()) {
+      b->used_ += b->step_;
+      if (b->cancelled_.load(std::memory_order_relaxed)) {
+        b->expired_ = error::type::cancelled;
+      } else if (b->instructions_ != 0 && b->used_ >= b->instructions_) {
+        b->expired_ = error::type::timeout;
+      } else if (b->wall_time_ != clock::duration::zero() && b->elapsed() >= b->wall_time_) {
+        b->expired_ = error::type::timeout;
+      }
+    }
+    if (b->expired()) {
+      // Check every instruction from now on, so the error is raised again as
+      // soon as a pcall in the script catches it.
+      lua_sethook(L, &hook, LUA_MASKCOUNT, 1);
+      lua_pushlightuserdata(L, error::sentinel(b->expired_));
+      lua_error(L);
+    }
+  }
+
+  lua_State* L;
+  size_t instructions_;
+  size_t used_;
+  int step_;
+  clock::time_point start_;
+  clock::duration wall_time_;
+  detail::interpreter::hold interpret_;
+  std::atomic<bool> cancelled_;
+  error::type expired_;
+  budget* previous_;
+  lua_Hook previous_hook_;
+  int previous_mask_;
+  int previous_count_;
+};
+
+}
@@ -0,0 +1,259 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "luapp11/bytecode.hpp"
+#include "luapp11/internal/mapped_file.hpp"
+
+namespace luapp11 {
+
+class var;
+class state;
+
+/**
+ * Many lua modules in one file, mapped into memory and loaded by require.  A module is only compiled the first time
+ * it's required, so modules a process never uses cost nothing but their index entry.
+ *
+ * <pre>
+ *   bundle::write("app.bundle", { { "app.rules", "src/rules.lua" }, { "app.util", "src/util.lua" } });
+ *   bundle("app.bundle").install(global);
+ *   do_chunk("local rules = require 'app.rules'");
+ * </pre>
+ *
+ * The file starts with the magic "LUAPP11B" and a uint64 count, followed by an index of count records of four
+ * uint64s each: name offset, name size, blob offset, and blob size.  Records are sorted by name, and offsets are from
+ * the start of the file.  Blobs are bytecode or lua source.  Numbers are in the byte order of the machine which wrote
+ * the bundle, and bytecode only loads into the same build of LuaJIT.
+ */
+class bundle {
+ public:
+  /**
+   * Map a bundle into memory.  Throws if the file can't be opened or isn't a bundle.
+   * @param path  The location of the bundle on disk.
+   */
+  explicit bundle(const std::string& path) : data_ { std::make_shared<data>(path) }
+  {
+    if (!data_->valid()) {
+      throw exception("Not a luapp11 bundle: " + path);
+    }
+  }
+
+  /**
+   * The number of modules in the bundle.
+   */
+  size_t size() const { return data_->count; }
+
+  /**
+   * Whether the bundle has a module.
+   * @param name  The name passed to require.
+   */
+  bool contains(const std::string& name) const { return data_->find(name.data(), name.size()) != nullptr; }
+
+  /**
+   * The number of modules compiled so far, across every state the bundle is installed in.
+   */
+  size_t loads() const { return data_->loads; }
+
+  /**
+   * Let require find modules in this bundle.  Adds a searcher to package.loaders, after package.preload and before
+   * the file system.  The bundle stays mapped as long as the state can use it, and must not be truncated or rewritten
+   * in place meanwhile; replace it by renaming a new file over it.
+   * @param v  Any location in the lua state.
+   */
+  void install(const var& v) const;
+
+  /**
+   * Let require in a lua state find modules in this bundle.
+   */
+  void install(const state& s) const;
+
+  /**
+   * Write a bundle.
+   * @param out      Where to write the bundle.
+   * @param modules  Pairs of module name and the location of its script on disk.
+   * @param compile  Store bytecode rather than source.
+   * @param strip    Leave debug info out of the bytecode.
+   * @return         The error (if any) which occured while compiling or writing.
+   */
+  static error write(const std::string& out, const std::vector<std::pair<std::string, std::string>>& modules,
+                     bool compile = true, bool strip = false) {
+    std::vector<std::pair<std::string, std::string>> blobs;
+    detail::scratch_state s;
+    for (auto& m : modules) {
+      std::string blob;
+      if (compile) {
+        int err = detail::dump(s.L, m.second, blob, strip);
+        if (err != 0) {
+          return error(err, "Unable to load file.", s.L);
+        }
+      } else {
+        detail::mapped_file file(m.second);
+        if (!file.opened) {
+          lua_pushstring(s.L, ("cannot open " + m.second).c_str());
+          return error(LUA_ERRFILE, "Unable to load file.", s.L);
+        }
+        blob.assign(file.data, file.size);
+      }
+      blobs.emplace_back(m.first, std::move(blob));
+    }
+    std::sort(blobs.begin(), blobs.end());
+
+    uint64_t names = header_size + blobs.size() * record_size;
+    uint64_t offset = names;
+    for (auto& b : blobs) {
+      offset += b.first.size();
+    }
+    std::vector<uint64_t> index;
+    for (auto& b : blobs) {
+      index.insert(index.end(), { names, b.first.size(), offset, b.second.size() });
+      names += b.first.size();
+      offset += b.second.size();
+    }
+
+    std::ofstream file(out, std::ios::binary | std::ios::trunc);
+    uint64_t count = blobs.size();
+    file.write(magic(), 8);
+    file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    file.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(uint64_t));
+    for (auto& b : blobs) {
+      file.write(b.first.data(), b.first.size());
+    }
+    for (auto& b : blobs) {
+      file.write(b.second.data(), b.second.size());
+    }
+    if (!file) {
+      lua_pushstring(s.L, ("cannot write " + out).c_str());
+      return error(LUA_ERRFILE, "Unable to write file.", s.L);
+    }
+    return error();
+  }
+
+ private:
+  static const size_t header_size = 16;
+  static const size_t record_size = 32;
+
+  static const char* magic() { return "LUAPP11B"; }
+
+  struct data {
+    explicit data(const std::string& path) : file { path }
+    , count { 0 }
+    , loads { 0 }
+    {
+      if (file.size >= header_size && std::memcmp(file.data, magic(), 8) == 0) {
+        std::memcpy(&count, file.data + 8, sizeof(count));
+      }
+    }
+
+    uint64_t field(size_t record, int f) const {
+      uint64_t v;
+      std::memcpy(&v, file.data + header_size + record * record_size + f * sizeof(uint64_t), sizeof(v));
+      return v;
+    }
+
+    bool in_file(uint64_t offset, uint64_t size) const { return offset <= file.size && size <= file.size - offset; }
+
+    // Every record has to point inside the file, so lookups don't need to
+    // check again.
+    bool valid() const {
+      if (file.size < header_size || std::memcmp(file.data, magic(), 8) != 0 ||
+          count > (file.size - header_size) / record_size) {
+        return false;
+      }
+      for (size_t i = 0; i < count; i++) {
+        if (!in_file(field(i, 0), field(i, 1)) || !in_file(field(i, 2), field(i, 3))) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    // The blob of a module, by binary search of the sorted index.
+    const char* find(const char* module, size_t length, size_t* size = nullptr) const {
+      size_t lo = 0, hi = count;
+      while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        size_t name_size = field(mid, 1);
+        int cmp = std::memcmp(file.data + field(mid, 0), module, std::min<size_t>(name_size, length));
+        if (cmp == 0) {
+          cmp = name_size < length ? -1 : name_size > length ? 1 : 0;
+        }
+        if (cmp == 0) {
+          if (size != nullptr) {
+            *size = field(mid, 3);
+          }
+          return file.data + field(mid, 2);
+        }
+        if (cmp < 0) {
+          lo = mid + 1;
+        } else {
+          hi = mid;
+        }
+      }
+      return nullptr;
+    }
+
+    detail::mapped_file file;
+    uint64_t count;
+    std::atomic<size_t> loads;
+  };
+
+  typedef std::shared_ptr<data> handle;
+
+  static int collect(lua_State* L) {
+    static_cast<handle*>(lua_touserdata(L, 1))->~handle();
+    return 0;
+  }
+
+  // A package.loaders entry.  Returns the compiled module, or why it isn't
+  // in the bundle.
+  static int search(lua_State* L) {
+    data& d = **static_cast<handle*>(lua_touserdata(L, lua_upvalueindex(1)));
+    size_t length;
+    const char* name = luaL_checklstring(L, 1, &length);
+    size_t size;
+    const char* blob = d.find(name, length, &size);
+    if (blob == nullptr) {
+      lua_pushfstring(L, "\n\tno module '%s' in bundle", name);
+      return 1;
+    }
+    d.loads++;
+    lua_pushfstring(L, "@%s", name);
+    if (luaL_loadbuffer(L, blob, size, lua_tostring(L, -1)) != 0) {
+      return luaL_error(L, "error loading module '%s' from bundle:\n\t%s", name, lua_tostring(L, -1));
+    }
+    return 1;
+  }
+
+  void install(lua_State* L) const {
+    int top = lua_gettop(L);
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "loaders");
+    int loaders = lua_gettop(L);
+    new (lua_newuserdata(L, sizeof(handle))) handle(data_);
+    lua_createtable(L, 0, 1);
+    lua_pushcfunction(L, &collect);
+    lua_setfield(L, -2, "__gc");
+    lua_setmetatable(L, -2);
+    lua_pushcclosure(L, &search, 1);
+    // Shift the file system searchers up to make room after preload.
+    for (int i = (int) lua_objlen(L, loaders); i >= 2; i--) {
+      lua_rawgeti(L, loaders, i);
+      lua_rawseti(L, loaders, i + 1);
+    }
+    lua_rawseti(L, loaders, 2);
+    lua_settop(L, top);
+  }
+
+  handle data_;
+};
+
+}
@@ -0,0 +1,317 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "luapp11/internal/mapped_file.hpp"
+#include "luapp11/internal/state_local.hpp"
+
+namespace luapp11 {
+
+class var;
+class state;
+
+namespace detail {
+
+// A lua state with just the string library, for compiling.  Closed when it
+// goes out of scope.
+struct scratch_state {
+  scratch_state() : L { luaL_newstate() }
+  {
+    lua_pushcfunction(L, luaopen_string);
+    lua_call(L, 0, 0);
+  }
+  ~scratch_state() { lua_close(L); }
+
+  scratch_state(const scratch_state&) = delete;
+  scratch_state& operator=(const scratch_state&) = delete;
+
+  lua_State* L;
+};
+
+inline int append_bytecode(lua_State*, const void* p, size_t size, void* out) {
+  static_cast<std::string*>(out)->append(static_cast<const char*>(p), size);
+  return 0;
+}
+
+// Compiles a file to bytecode in a scratch state.  Leaves the stack as it
+// found it, or the error message on top.
+inline int dump(lua_State* L, const std::string& path, std::string& bytecode, bool strip) {
+  int top = lua_gettop(L);
+  int err = load_whole(L, path);
+  if (err != 0) {
+    return err;
+  }
+  bytecode.clear();
+  if (!strip) {
+    lua_dump(L, &append_bytecode, &bytecode);
+  } else {
+    // lua_dump can't strip, string.dump can.
+    lua_getglobal(L, "string");
+    lua_getfield(L, -1, "dump");
+    lua_pushvalue(L, -3);
+    lua_pushboolean(L, 1);
+    err = lua_pcall(L, 2, 1, 0);
+    if (err != 0) {
+      lua_replace(L, top + 1);
+      lua_settop(L, top + 1);
+      return err;
+    }
+    size_t size;
+    const char* p = lua_tolstring(L, -1, &size);
+    bytecode.assign(p, size);
+  }
+  lua_settop(L, top);
+  return 0;
+}
+
+// A file's modification time as seconds and nanoseconds.  Where the platform
+// only keeps seconds the nanoseconds are 0.
+inline std::pair<long long, long> modified(const struct stat& st) {
+#if defined(__APPLE__)
+  return std::make_pair((long long) st.st_mtimespec.tv_sec, (long) st.st_mtimespec.tv_nsec);
+#elif defined(_WIN32)
+  return std::make_pair((long long) st.st_mtime, 0L);
+#else
+  return std::make_pair((long long) st.st_mtim.tv_sec, (long) st.st_mtim.tv_nsec);
+#endif
+}
+
+// Whether a file exists and was last modified after another, to the
+// nanosecond where the platform keeps it.  A tie counts as older, since a
+// script saved in the same clock tick as its bytecode was compiled may have
+// changed since.
+inline bool newer(const std::string& path, const std::string& than) {
+  struct stat a, b;
+  if (stat(path.c_str(), &a) != 0) {
+    return false;
+  }
+  if (stat(than.c_str(), &b) != 0) {
+    return true;
+  }
+  return modified(a) > modified(b);
+}
+
+}
+
+/**
+ * Compiled lua bytecode kept in memory, keyed by the path of the script it was compiled from.  do_file loads the
+ * bytecode instead of reading the script.  There is one store per lua state.
+ *
+ * Scripts can be compiled in parallel before they're needed:
+ * <pre>
+ *   bytecode_store::of(global).compile(paths);
+ *   for (auto& path : paths) do_file(path);
+ * </pre>
+ */
+class bytecode_store {
+ public:
+  explicit bytecode_store(lua_State* L) : L { L }
+  , loads_ { 0 }
+  {}
+
+  /**
+   * The store of the lua state a var belongs to.
+   * @param v  Any location in the lua state.
+   */
+  static bytecode_store& of(const var& v);
+
+  /**
+   * The store of a lua state.
+   */
+  static bytecode_store& of(const state& s);
+
+  /**
+   * Use bytecode in place of a script.
+   * @param path      The path do_file will be called with.
+   * @param bytecode  The output of dump_file or compile_file.
+   */
+  void add(const std::string& path, std::string bytecode) { blobs_[path] = std::move(bytecode); }
+
+  /**
+   * Go back to loading a script from disk.
+   */
+  void remove(const std::string& path) { blobs_.erase(path); }
+
+  /**
+   * Whether a script is loaded from bytecode in memory.
+   */
+  bool contains(const std::string& path) const { return blobs_.count(path) != 0; }
+
+  /**
+   * The number of scripts with bytecode in memory.
+   */
+  size_t size() const { return blobs_.size(); }
+
+  /**
+   * The number of times do_file used bytecode from the store.
+   */
+  size_t loads() const { return loads_; }
+
+  /**
+   * Compile many scripts at once, each worker thread in its own scratch lua state, then add their bytecode to the
+   * store.  Nothing is run: do_file on each path runs it later without parsing.
+   * @param paths    The locations of the scripts on disk.
+   * @param strip    Leave out debug info.
+   * @param threads  The number of threads to compile on, including the calling one.  0 for one per core.
+   * @return         The error of the first script (in order) which didn't compile.  The others are still added.
+   */
+  error compile(const std::vector<std::string>& paths, bool strip = false, unsigned threads = 0) {
+    std::vector<std::string> bytecode;
+    auto err = compile_all(paths, bytecode, strip, threads);
+    for (size_t i = 0; i < paths.size(); i++) {
+      if (!bytecode[i].empty()) {
+        blobs_[paths[i]] = std::move(bytecode[i]);
+      }
+    }
+    return err;
+  }
+
+  /**
+   * Compile many modules at once like compile(), then load each into package.preload so require runs it.  Modules
+   * which are never required are never run.
+   * @param modules  Pairs of module name and the location of its script on disk.
+   * @param strip    Leave out debug info.
+   * @param threads  The number of threads to compile on, including the calling one.  0 for one per core.
+   * @return         The error of the first module (in order) which didn't compile.  The others are still loaded.
+   */
+  error preload(const std::vector<std::pair<std::string, std::string>>& modules, bool strip = false,
+                unsigned threads = 0) {
+    std::vector<std::string> paths;
+    for (auto& m : modules) {
+      paths.push_back(m.second);
+    }
+    std::vector<std::string> bytecode;
+    auto err = compile_all(paths, bytecode, strip, threads);
+    int top = lua_gettop(L);
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "preload");
+    for (size_t i = 0; i < modules.size(); i++) {
+      if (bytecode[i].empty()) {
+        continue;
+      }
+      int loadError = luaL_loadbuffer(L, bytecode[i].data(), bytecode[i].size(), ("@" + paths[i]).c_str());
+      if (loadError != 0) {
+        if (!err) {
+          err = error(loadError, "Unable to load module.", L);
+        }
+        lua_settop(L, top + 2);
+        continue;
+      }
+      lua_setfield(L, -2, modules[i].first.c_str());
+    }
+    lua_settop(L, top);
+    return err;
+  }
+
+ private:
+  // Compiles every path, in parallel.  Failed paths are left empty.
+  error compile_all(const std::vector<std::string>& paths, std::vector<std::string>& bytecode, bool strip,
+                    unsigned threads) {
+    bytecode.assign(paths.size(), std::string());
+    std::vector<std::unique_ptr<error>> errors(paths.size());
+    std::atomic<size_t> next { 0 };
+    auto work = [&]() {
+      detail::scratch_state s;
+      for (size_t i = next++; i < paths.size(); i = next++) {
+        int err = detail::dump(s.L, paths[i], bytecode[i], strip);
+        if (err != 0) {
+          errors[i].reset(new error(err, "Unable to load file.", s.L));
+          bytecode[i].clear();
+        }
+      }
+    };
+    if (threads == 0) {
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = (unsigned) std::min<size_t>(threads, std::max<size_t>(paths.size(), 1));
+    std::vector<std::thread> workers;
+    for (unsigned t = 1; t < threads; t++) {
+      workers.emplace_back(work);
+    }
+    work();
+    for (auto& w : workers) {
+      w.join();
+    }
+    for (auto& e : errors) {
+      if (e) {
+        return *e;
+      }
+    }
+    return error();
+  }
+
+  // Pushes the compiled file.  Prefers bytecode in the store, then a .luac
+  // file next to the script which is newer, then the script.
+  // Files are read whole, in one piece.
+  int load(lua_State* L, const std::string& path) {
+    auto found = blobs_.find(path);
+    if (found != blobs_.end()) {
+      loads_++;
+      return luaL_loadbuffer(L, found->second.data(), found->second.size(), ("@" + path).c_str());
+    }
+    std::string sidecar = path + "c";
+    if (detail::newer(sidecar, path)) {
+      return detail::load_whole(L, sidecar);
+    }
+    return detail::load_whole(L, path);
+  }
+
+  lua_State* L;
+  std::unordered_map<std::string, std::string> blobs_;
+  size_t loads_;
+
+  friend class var;
+  friend class state;
+};
+
+/**
+ * Compile a lua file to bytecode in memory.  Nothing is run.
+ * @param path      The location of the script on disk.
+ * @param bytecode  Where to put the bytecode.
+ * @param strip     Leave out debug info: smaller and faster to load, but errors lose their line numbers.
+ * @return          The error (if any) which occured while compiling.
+ */
+inline error dump_file(const std::string& path, std::string& bytecode, bool strip = false) {
+  detail::scratch_state s;
+  int err = detail::dump(s.L, path, bytecode, strip);
+  if (err != 0) {
+    return error(err, "Unable to load file.", s.L);
+  }
+  return error();
+}
+
+/**
+ * Compile a lua file to a bytecode file.  do_file prefers a path + "c" file (script.lua -> script.luac) which was
+ * modified after the script.
+ * @param path   The location of the script on disk.
+ * @param out    Where to write the bytecode.
+ * @param strip  Leave out debug info: smaller and faster to load, but errors lose their line numbers.
+ * @return       The error (if any) which occured while compiling or writing.
+ */
+inline error compile_file(const std::string& path, const std::string& out, bool strip = false) {
+  std::string bytecode;
+  auto err = dump_file(path, bytecode, strip);
+  if (err) {
+    return err;
+  }
+  std::ofstream file(out, std::ios::binary | std::ios::trunc);
+  file.write(bytecode.data(), bytecode.size());
+  if (!file) {
+    detail::scratch_state s;
+    lua_pushstring(s.L, ("cannot write " + out).c_str());
+    return error(LUA_ERRFILE, "Unable to write file.", s.L);
+  }
+  return error();
+}
+
+}
@@ -0,0 +1,317 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "luapp11/internal/serialize.hpp"
+
+namespace luapp11 {
+
+class var;
+
+/**
+ * A bounded queue of lua values between lua states, for pipelines of states on different threads.  Values are
+ * serialized when sent and rebuilt in the receiving state, so tables are copied, not shared.  Functions, full
+ * userdata, and coroutines can't be sent.
+ *
+ * <pre>
+ *   channel jobs(1024);
+ *   jobs.bind(producer["jobs"]);
+ *   jobs.bind(consumer["jobs"]);
+ *   // in the producer:  jobs:send({ id = 1, path = "a.txt" })
+ *   // in the consumer:  local job = jobs:recv()
+ * </pre>
+ *
+ * The queue is a lock-free ring buffer.  Any number of threads can send at once, but only one may receive at a
+ * time.  A channel made for a single producer skips the compare and swap on send.  Copies of a channel share the
+ * same queue.
+ *
+ * In lua a bound channel has the methods send(value), try_send(value), recv() and try_recv().  send and recv wait
+ * while the channel is full or empty: inside a coroutine they yield, so a scheduler can run other tasks, and
+ * outside one they block the thread.  try_send returns whether the value was sent, and try_recv returns true and
+ * the value, or false.
+ */
+class channel {
+ public:
+  /**
+   * @param capacity         The most values the channel holds before send waits.  Rounded up to a power of two.
+   * @param single_producer  Only one thread will ever send at a time.
+   */
+  explicit channel(size_t capacity = 1024, bool single_producer = false)
+      : ring_ { std::make_shared<ring>(capacity, single_producer) }
+  {}
+
+  /**
+   * The most values the channel holds.
+   */
+  size_t capacity() const { return ring_->cells.size(); }
+
+  /**
+   * The number of values waiting to be received.  Only a snapshot while other threads use the channel.
+   */
+  size_t size() const { return ring_->tail.load() - ring_->head.load(); }
+
+  /**
+   * Send a value if there's room.  Throws if the value can't be serialized.
+   * @param v  The location of the value to send.
+   * @return   Whether the value was sent.
+   */
+  bool try_send(const var& v);
+
+  /**
+   * Send a value, waiting for room.  Throws if the value can't be serialized.
+   * @param v  The location of the value to send.
+   */
+  void send(const var& v) {
+    for (unsigned waits = 0; !try_send(v); waits++) {
+      backoff(waits);
+    }
+  }
+
+  /**
+   * Receive a value if one is waiting.
+   * @param v  The location to assign the value to.
+   * @return   Whether a value was received.
+   */
+  bool try_recv(var v);
+
+  /**
+   * Receive a value, waiting for one.
+   * @param v  The location to assign the value to.
+   */
+  void recv(var v);
+
+  /**
+   * Let lua code use the channel.
+   * @param v  The location to put the channel at, as a userdata with send, try_send, recv and try_recv methods.
+   */
+  void bind(const var& v) const;
+
+ private:
+  // Dmitry Vyukov's bounded queue.  Each cell's sequence says whose turn it
+  // is: equal to a position when a sender may fill it, one past when the
+  // receiver may empty it.
+  struct ring {
+    struct cell {
+      std::atomic<size_t> sequence;
+      std::string data;
+    };
+
+    ring(size_t capacity, bool single_producer) : cells(round_up(capacity))
+    , mask { cells.size() - 1 }
+    , single_producer { single_producer }
+    , head { 0 }
+    , tail { 0 }
+    {
+      for (size_t i = 0; i < cells.size(); i++) {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+      }
+    }
+
+    static size_t round_up(size_t capacity) {
+      size_t size = 2;
+      while (size < capacity) {
+        size *= 2;
+      }
+      return size;
+    }
+
+    // Swaps data into a free cell.  data gets back the buffer a receiver
+    // left there, so buffers are reused rather than reallocated.
+    bool push(std::string& data) {
+      size_t pos = tail.load(std::memory_order_relaxed);
+      cell* c;
+      while (true) {
+        c = &cells[pos & mask];
+        size_t seq = c->sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+        if (diff == 0) {
+          if (single_producer) {
+            tail.store(pos + 1, std::memory_order_relaxed);
+            break;
+          }
+          if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+            break;
+          }
+        } else if (diff < 0) {
+          return false;
+        } else {
+          pos = tail.load(std::memory_order_relaxed);
+        }
+      }
+      c->data.swap(data);
+      c->sequence.store(pos + 1, std::memory_order_release);
+      return true;
+    }
+
+    bool pop(std::string& data) {
+      size_t pos = head.load(std::memory_order_relaxed);
+      cell& c = cells[pos & mask];
+      if (c.sequence.load(std::memory_order_acquire) != pos + 1) {
+        return false;
+      }
+      data.swap(c.data);
+      head.store(pos + 1, std::memory_order_relaxed);
+      c.sequence.store(pos + cells.size(), std::memory_order_release);
+      return true;
+    }
+
+    bool empty() const {
+      size_t pos = head.load(std::memory_order_relaxed);
+      return cells[pos & mask].sequence.load(std::memory_order_acquire) != pos + 1;
+    }
+
+    bool full() const {
+      size_t pos = tail.load(std::memory_order_relaxed);
+      return cells[pos & mask].sequence.load(std::memory_order_acquire) != pos;
+    }
+
+    std::vector<cell> cells;
+    const size_t mask;
+    const bool single_producer;
+    std::atomic<size_t> head;
+    // Keeps senders and the receiver off each other's cache line.
+    char padding[64];
+    std::atomic<size_t> tail;
+  };
+
+  typedef std::shared_ptr<ring> handle;
+
+  static const char* metatable() { return "luapp11.channel"; }
+
+  // Spins briefly, then sleeps, so a long wait doesn't hold a core.
+  static void backoff(unsigned waits) {
+    if (waits < 64) {
+      std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  }
+
+  // One buffer per thread for encoding and decoding, which the ring trades
+  // with its cells.
+  static std::string& buffer() {
+    static thread_local std::string b;
+    return b;
+  }
+
+  // Serializes the value at idx and queues it.  Returns what couldn't be
+  // serialized, or nullptr.
+  static const char* push(ring& r, lua_State* L, int idx, bool& sent) {
+    std::string& b = buffer();
+    b.clear();
+    const char* failed = detail::serialize(L, idx, b);
+    sent = failed == nullptr && r.push(b);
+    return failed;
+  }
+
+  // Pushes the next value, if there is one.
+  static bool pop(ring& r, lua_State* L) {
+    std::string& b = buffer();
+    if (!r.pop(b)) {
+      return false;
+    }
+    if (!detail::deserialize(L, b.data(), b.size())) {
+      throw exception("Unable to read channel message.");
+    }
+    return true;
+  }
+
+  static ring& self(lua_State* L) { return **static_cast<handle*>(luaL_checkudata(L, 1, metatable())); }
+
+  static int collect(lua_State* L) {
+    static_cast<handle*>(lua_touserdata(L, 1))->~handle();
+    return 0;
+  }
+
+  static int bound_try_send(lua_State* L) {
+    ring& r = self(L);
+    lua_settop(L, 2);
+    bool sent;
+    const char* failed = push(r, L, 2, sent);
+    if (failed != nullptr) {
+      return luaL_error(L, "Unable to send %s.", failed);
+    }
+    lua_pushboolean(L, sent);
+    return 1;
+  }
+
+  static int bound_try_recv(lua_State* L) {
+    ring& r = self(L);
+    std::string& b = buffer();
+    if (!r.pop(b)) {
+      lua_pushboolean(L, 0);
+      return 1;
+    }
+    lua_pushboolean(L, 1);
+    if (!detail::deserialize(L, b.data(), b.size())) {
+      return luaL_error(L, "Unable to read channel message.");
+    }
+    return 2;
+  }
+
+  // Blocks the thread a little while the channel is full (when sending) or
+  // empty.  send and recv call it in a loop outside coroutines.
+  static int bound_wait(lua_State* L) {
+    ring& r = self(L);
+    bool sending = lua_toboolean(L, 2) != 0;
+    for (unsigned waits = 0; waits < 128 && (sending ? r.full() : r.empty()); waits++) {
+      backoff(waits);
+    }
+    return 0;
+  }
+
+  // send and recv are lua, so they can yield.
+  static void push_metatable(lua_State* L) {
+    if (luaL_newmetatable(L, metatable()) == 0) {
+      return;
+    }
+    int meta = lua_gettop(L);
+    lua_pushcfunction(L, &collect);
+    lua_setfield(L, meta, "__gc");
+    lua_createtable(L, 0, 4);
+    int methods = lua_gettop(L);
+    lua_pushcfunction(L, &bound_try_send);
+    lua_setfield(L, methods, "try_send");
+    lua_pushcfunction(L, &bound_try_recv);
+    lua_setfield(L, methods, "try_recv");
+    luaL_loadstring(L, "local try_send, try_recv, wait = ... "
+                       "local running, yield = coroutine.running, coroutine.yield "
+                       "local function pause(self, sending) "
+                       "  local co, main = running() "
+                       "  if co and not main then yield() else wait(self, sending) end "
+                       "end "
+                       "return function(self, v) "
+                       "  while not try_send(self, v) do pause(self, true) end "
+                       "end, function(self) "
+                       "  while true do "
+                       "    local ok, v = try_recv(self) "
+                       "    if ok then return v end "
+                       "    pause(self, false) "
+                       "  end "
+                       "end");
+    lua_pushcfunction(L, &bound_try_send);
+    lua_pushcfunction(L, &bound_try_recv);
+    lua_pushcfunction(L, &bound_wait);
+    lua_call(L, 3, 2);
+    lua_setfield(L, methods, "recv");
+    lua_setfield(L, methods, "send");
+    lua_setfield(L, meta, "__index");
+  }
+
+  void bind(lua_State* L) const {
+    new (lua_newuserdata(L, sizeof(handle))) handle(ring_);
+    push_metatable(L);
+    lua_setmetatable(L, -2);
+  }
+
+  handle ring_;
+};
+
+}
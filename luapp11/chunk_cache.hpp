@@ -0,0 +1,149 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "luapp11/internal/reference.hpp"
+#include "luapp11/internal/state_local.hpp"
+
+namespace luapp11 {
+
+class var;
+class state;
+
+/**
+ * The compiled functions of chunks run with do_chunk, keyed by their source, so running the same code again skips
+ * straight to calling it.  There is one cache per lua state.  The least recently used chunks are dropped once the
+ * source of all cached chunks passes the capacity.
+ *
+ * The capacity counts bytes of source only, not the compiled functions the cache keeps alive, which are usually
+ * several times larger.  It limits how much the cache holds, but doesn't bound its memory to that many bytes.
+ *
+ * A cached chunk is the same lua function every time it runs.  Chunks which change their own environment with
+ * setfenv keep it the next time.  Set the capacity to 0 to turn caching off.
+ */
+class chunk_cache {
+ public:
+  explicit chunk_cache(lua_State*) : capacity_ { 1 << 20 }
+  , memory_ { 0 }
+  , hits_ { 0 }
+  , misses_ { 0 }
+  , evictions_ { 0 }
+  {}
+
+  /**
+   * The cache of the lua state a var belongs to.
+   * @param v  Any location in the lua state.
+   */
+  static chunk_cache& of(const var& v);
+
+  /**
+   * The cache of a lua state.
+   */
+  static chunk_cache& of(const state& s);
+
+  /**
+   * The most bytes of chunk source kept cached.  Defaults to 1MB of source.  The compiled functions aren't counted.
+   */
+  size_t capacity() const { return capacity_; }
+
+  /**
+   * Sets the most bytes of chunk source kept cached.  Drops the least recently used chunks until the cache fits.
+   */
+  void set_capacity(size_t capacity) {
+    capacity_ = capacity;
+    shrink();
+  }
+
+  /**
+   * Drops every cached chunk.  Doesn't count as evictions.
+   */
+  void clear() {
+    order_.clear();
+    entries_.clear();
+    memory_ = 0;
+  }
+
+  /**
+   * The number of cached chunks.
+   */
+  size_t size() const { return entries_.size(); }
+
+  /**
+   * The bytes of chunk source currently cached.  Not the memory the compiled functions use.
+   */
+  size_t memory() const { return memory_; }
+
+  /**
+   * The number of chunks which were already compiled.
+   */
+  size_t hits() const { return hits_; }
+
+  /**
+   * The number of chunks which had to be compiled.
+   */
+  size_t misses() const { return misses_; }
+
+  /**
+   * The number of chunks dropped to stay under the capacity.
+   */
+  size_t evictions() const { return evictions_; }
+
+ private:
+  typedef std::list<const std::string*> order;
+
+  struct entry {
+    std::unique_ptr<detail::reference> fn;
+    order::iterator used;
+  };
+
+  // Pushes the compiled chunk.  Returns the luaL_loadstring error, with the
+  // message pushed instead, if it doesn't compile.
+  int load(lua_State* L, const std::string& str) {
+    auto found = entries_.find(str);
+    if (found != entries_.end()) {
+      hits_++;
+      order_.splice(order_.begin(), order_, found->second.used);
+      found->second.fn->push();
+      return 0;
+    }
+    misses_++;
+    int err = luaL_loadstring(L, str.c_str());
+    if (err != 0 || str.size() > capacity_) {
+      return err;
+    }
+    lua_pushvalue(L, -1);
+    auto& e = entries_[str];
+    e.fn.reset(new detail::reference(L));
+    order_.push_front(&entries_.find(str)->first);
+    e.used = order_.begin();
+    memory_ += str.size();
+    shrink();
+    return 0;
+  }
+
+  void shrink() {
+    while (memory_ > capacity_ && !order_.empty()) {
+      const std::string* str = order_.back();
+      order_.pop_back();
+      memory_ -= str->size();
+      entries_.erase(entries_.find(*str));
+      evictions_++;
+    }
+  }
+
+  size_t capacity_;
+  size_t memory_;
+  size_t hits_;
+  size_t misses_;
+  size_t evictions_;
+  order order_;
+  std::unordered_map<std::string, entry> entries_;
+
+  friend class var;
+  friend class state;
+};
+
+}
@@ -0,0 +1,397 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "luapp11/internal/interpreter.hpp"
+#include "luapp11/internal/reference.hpp"
+#include "luapp11/internal/state_local.hpp"
+
+namespace luapp11 {
+
+/**
+ * The lua threads of finished coroutines, kept for reuse by new coroutines on the same lua state.  Saves the
+ * allocation and garbage collection of a new lua thread for every coroutine.  There is one pool per lua state.
+ */
+class coroutine_pool {
+ public:
+  explicit coroutine_pool(lua_State*) : capacity_ { 64 }
+  , created_ { 0 }
+  , reused_ { 0 }
+  {}
+
+  /**
+   * The most threads kept for reuse.  Defaults to 64.
+   */
+  size_t capacity() const { return capacity_; }
+
+  /**
+   * Sets the most threads kept for reuse.  Extra threads are released to the garbage collector.
+   */
+  void set_capacity(size_t capacity) {
+    capacity_ = capacity;
+    if (free_.size() > capacity_) {
+      free_.resize(capacity_);
+    }
+  }
+
+  /**
+   * The number of threads currently waiting to be reused.
+   */
+  size_t size() const { return free_.size(); }
+
+  /**
+   * The number of coroutines which needed a new lua thread.
+   */
+  size_t created() const { return created_; }
+
+  /**
+   * The number of coroutines which reused a pooled lua thread.
+   */
+  size_t reused() const { return reused_; }
+
+ private:
+  struct thread {
+    lua_State* state;
+    std::unique_ptr<detail::reference> ref;
+  };
+
+  thread acquire(lua_State* L) {
+    thread t;
+    if (free_.empty()) {
+      t.state = lua_newthread(L);
+      t.ref.reset(new detail::reference(L));
+      created_++;
+    } else {
+      t = std::move(free_.back());
+      free_.pop_back();
+      reused_++;
+    }
+    return t;
+  }
+
+  void release(thread && t) {
+    if (free_.size() < capacity_) {
+      lua_settop(t.state, 0);
+      free_.push_back(std::move(t));
+    }
+  }
+
+  size_t capacity_;
+  size_t created_;
+  size_t reused_;
+  std::vector<thread> free_;
+
+  friend class coroutine;
+};
+
+/**
+ * A lua coroutine.  Runs a lua function on its own lua thread which can be suspended with coroutine.yield and
+ * resumed later from c++.  Copies share the same thread.
+ *
+ *     coroutine co(global["task"]);
+ *     auto first = co.resume<int>(10);
+ *     while (!co.done()) { co.resume<void>(); }
+ *
+ * The lua thread comes from the state's coroutine_pool, and goes back to it once the last copy of a coroutine
+ * which finished without error is destroyed.  A coroutine may outlive its lua state and is then safe to destroy, but
+ * resuming it throws.
+ */
+class coroutine {
+ public:
+  enum class status {
+    suspended,
+    finished,
+    error
+  };
+
+  /**
+   * Gets a lua thread to run the function at a place in the lua environment.
+   * @param v  The location of the function.
+   */
+  explicit coroutine(const var& v) {
+    lua_State* L = v.L;
+    stack_guard g(L);
+    v.push();
+    if (!lua_isfunction(L, -1)) {
+      throw exception("Tried to make a coroutine from a non-function.", L);
+    }
+    auto& p = detail::state_local<coroutine_pool>(L);
+    state_ = std::make_shared<state>(p, p.acquire(L));
+    lua_xmove(L, state_->thread.state, 1);
+  }
+
+  /**
+   * The coroutine pool for the lua state of a place in the lua environment.
+   */
+  static coroutine_pool& pool(const var& v) {
+    return detail::state_local<coroutine_pool>(v.L);
+  }
+
+  /**
+   * Start or continue running the coroutine.
+   * @param params  The arguments to the function on the first resume, or the values returned from
+   *                coroutine.yield afterwards.
+   * @return        The values passed to coroutine.yield, or returned by the function.
+   */
+  template <typename TOut, typename ... TParams>
+  result<TOut> resume(TParams && ... params) {
+    return resume_for<TOut>(0, std::forward<TParams>(params) ...);
+  }
+
+  /**
+   * Start or continue running the coroutine for at most a number of lua VM instructions.  If the slice runs out
+   * the coroutine is suspended where it is, preempted() is true, and the next resume continues it.
+   *
+   * Hooks don't run inside JIT compiled code, so while a sliced resume runs the JIT is flushed and turned off for
+   * the whole lua state, as for a budget, and turned back on afterwards if it was on.  Only a coroutine running
+   * lua code can be preempted.  A slice which runs out inside a lua function called from C, e.g. a table.sort
+   * comparator, preempts the coroutine as soon as it's back in lua code.  A hook which was already set, e.g. a
+   * budget's, keeps being called while the slice runs.
+   * @param instructions  The size of the slice.  0 runs until the coroutine yields or returns.
+   * @param params        The arguments to the function on the first resume, or the values returned from
+   *                      coroutine.yield afterwards.  Dropped when continuing a preempted coroutine.
+   * @return              The values passed to coroutine.yield, or returned by the function.
+   */
+  template <typename TOut, typename ... TParams>
+  result<TOut> resume_for(int instructions, TParams && ... params) {
+    int err = run(instructions, std::forward<TParams>(params) ...);
+    if (err != 0 && err != LUA_YIELD) {
+      return failed<TOut>(err);
+    }
+    return results<TOut>::get(state_->thread.state);
+  }
+
+  /**
+   * Whether the coroutine can be resumed, has returned, or has failed.
+   */
+  status get_status() const { return state_->status_; }
+
+  /**
+   * Whether the coroutine has returned or failed.
+   */
+  bool done() const { return state_->status_ != status::suspended; }
+
+  /**
+   * Whether the last resume was cut short because its slice ran out.
+   */
+  bool preempted() const { return state_->preempted; }
+
+ private:
+  // Pushes the arguments, unless continuing a preempted resume, and resumes
+  // the thread.  Leaves what it yielded or returned on the thread's stack, or
+  // the error message.
+  template <typename ... TParams> int run(int instructions, TParams && ... params) {
+    if (state_->status_ != status::suspended) {
+      throw exception("Tried to resume a dead coroutine.");
+    }
+    if (state_->thread.ref->closed()) {
+      throw exception("Tried to resume a coroutine whose lua state is closed.");
+    }
+    lua_State* thread = state_->thread.state;
+    int nargs = 0;
+    if (!state_->preempted) {
+      int in_order[] = { 0, (val::pusher<typename std::decay<TParams>::type>::
+                                 push(thread, std::forward<TParams>(params)),
+                             0) ... };
+      (void) in_order;
+      nargs = sizeof ...(TParams);
+    }
+
+    int err;
+    {
+      detail::interpreter::hold h(thread, instructions > 0);
+      slice s(thread, instructions);
+      err = lua_resume(thread, nargs);
+      state_->preempted = s.preempted;
+    }
+    if (err == 0) {
+      state_->status_ = status::finished;
+    } else if (err != LUA_YIELD) {
+      state_->status_ = status::error;
+    }
+    return err;
+  }
+
+  // Takes the error message off the thread's stack.
+  template <typename TOut> result<TOut> failed(int err) {
+    lua_State* thread = state_->thread.state;
+    result<TOut> ret = error(err, "Error resuming coroutine.", thread);
+    lua_settop(thread, 0);
+    return ret;
+  }
+
+  // Installs a count hook which yields a thread once a number of
+  // instructions have run.  The hook belongs to the whole lua state, so the
+  // one it replaces, e.g. a budget's, is called on its own schedule and put
+  // back afterwards.  Slices can nest when a sliced coroutine calls c++ which
+  // resumes another; the inner one pauses the outer.
+  struct slice {
+    slice(lua_State* t, int instructions) : thread { t }
+    , preempted { false }
+    , left { instructions }
+    , count { 0 }
+    , previous { current() }
+    , previous_hook { lua_gethook(t) }
+    , previous_mask { lua_gethookmask(t) }
+    , previous_count { lua_gethookcount(t) }
+    , since_previous { 0 }
+    {
+      if (instructions > 0) {
+        current() = this;
+        arm(instructions);
+      }
+    }
+
+    ~slice() {
+      if (current() == this) {
+        lua_sethook(thread, previous_hook, previous_mask, previous_count);
+        current() = previous;
+      }
+    }
+
+    static slice*& current() {
+      static thread_local slice* s = nullptr;
+      return s;
+    }
+
+    // Whether the previous hook wants counts passed on.
+    bool chained() const {
+      return previous_hook != nullptr && previous_hook != &hook && (previous_mask & LUA_MASKCOUNT) != 0 &&
+             previous_count > 0;
+    }
+
+    // Fires after n instructions, or sooner if the previous hook is due.
+    void arm(int n) {
+      count = chained() && previous_count - since_previous < n ? previous_count - since_previous : n;
+      lua_sethook(thread, &hook, previous_mask | LUA_MASKCOUNT, count);
+    }
+
+    static void hook(lua_State* L, lua_Debug* ar) {
+      slice* s = current();
+      if (s == nullptr) {
+        return;
+      }
+      if (ar->event != LUA_HOOKCOUNT) {
+        if (s->previous_hook != nullptr) {
+          s->previous_hook(L, ar);
+        }
+        return;
+      }
+      s->left -= s->count;
+      if (s->chained()) {
+        s->since_previous += s->count;
+        if (s->since_previous >= s->previous_count) {
+          s->since_previous = 0;
+          s->previous_hook(L, ar);
+        }
+      }
+      if (s->left > 0) {
+        s->arm(s->left);
+      } else if (L == s->thread && yieldable(L)) {
+        s->preempted = true;
+        lua_yield(L, 0);
+      } else {
+        // In a coroutine started inside the slice, or in lua called from C.
+        // Check again every instruction until the thread can yield.
+        s->arm(1);
+      }
+    }
+
+    // Whether a hook can yield the thread.  Not from lua called by a C
+    // function, except pcall and xpcall, which LuaJIT can yield across.
+    static bool yieldable(lua_State* L) {
+      lua_Debug ar;
+      for (int level = 1; lua_getstack(L, level, &ar) != 0; level++) {
+        lua_getinfo(L, "Sf", &ar);
+        bool c = ar.what[0] == 'C' && !is_global(L, "pcall") && !is_global(L, "xpcall");
+        lua_pop(L, 1);
+        if (c) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    // Whether the value on top of the stack is a global.
+    static bool is_global(lua_State* L, const char* name) {
+      lua_pushstring(L, name);
+      lua_rawget(L, LUA_GLOBALSINDEX);
+      bool same = lua_rawequal(L, -1, -2) != 0;
+      lua_pop(L, 1);
+      return same;
+    }
+
+    lua_State* thread;
+    bool preempted;
+    int left;
+    int count;
+    slice* previous;
+    lua_Hook previous_hook;
+    int previous_mask;
+    int previous_count;
+    int since_previous;
+  };
+
+  struct state {
+    state(coroutine_pool& p, coroutine_pool::thread && t) : pool { p }
+    , thread { std::move(t) }
+    , status_ { status::suspended }
+    , preempted { false }
+    {}
+
+    ~state() {
+      // The pool goes with the lua state.
+      if (status_ == status::finished && !thread.ref->closed()) {
+        pool.release(std::move(thread));
+      }
+    }
+
+    coroutine_pool& pool;
+    coroutine_pool::thread thread;
+    status status_;
+    bool preempted;
+  };
+
+  // Clears the thread's stack, even if converting the results throws.
+  struct clear_guard {
+    lua_State* thread;
+    ~clear_guard() { lua_settop(thread, 0); }
+  };
+
+  // Takes the yielded or returned values off the thread's stack.
+  template <typename T, class Enable = void> struct results {
+    static result<T> get(lua_State* thread) {
+      clear_guard g { thread };
+      if (lua_gettop(thread) < 1) {
+        lua_settop(thread, 1);
+      }
+      return val::popper<T>::get(thread, 1);
+    }
+  };
+
+  template <typename T>
+  struct results<T, typename std::enable_if<std::is_void<T>::value>::type> {
+    static result<T> get(lua_State* thread) {
+      lua_settop(thread, 0);
+      return result<T>();
+    }
+  };
+
+  template <typename ... TArgs>
+  struct results<std::tuple<TArgs ...>, std::enable_if<true>::type> {
+    static result<std::tuple<TArgs ...>> get(lua_State* thread) {
+      clear_guard g { thread };
+      if (lua_gettop(thread) < (int) sizeof ...(TArgs)) {
+        lua_settop(thread, sizeof ...(TArgs));
+      }
+      return val::popper<std::tuple<TArgs ...>>::get(thread, 1);
+    }
+  };
+
+  std::shared_ptr<state> state_;
+
+  friend class scheduler;
+};
+
+}
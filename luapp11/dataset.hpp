@@ -0,0 +1,270 @@
+#pragma once
+
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace luapp11 {
+
+/**
+ * Read-only data owned by c++ and shared by any number of lua states without copying it into them.  Each state
+ * gets a small userdata which reads the shared data directly, so a large dataset costs the same in every state after
+ * the first.  The data must not change while any state can see it; reading it from many threads at once is safe.
+ *
+ * <pre>
+ *   auto prices = std::make_shared<const std::unordered_map<std::string, double>>(load_prices());
+ *   dataset d = dataset::of(prices);
+ *   for (auto& s : states) d.bind(s["prices"]);
+ *   // in lua:  local p = prices["ACME"]   local n = #prices   for k, v in prices() do ... end
+ * </pre>
+ *
+ * In lua a dataset can be indexed, has a length, and calling it returns an iterator over its entries.  pairs works
+ * too where LuaJIT honours __pairs.  Assigning to a field is an error.
+ */
+class dataset {
+ public:
+  /**
+   * The interface to a shared structure.  Implement it for structures other than vectors and hash maps.  Every
+   * method may be called from many threads at once.
+   */
+  struct source {
+    virtual ~source() {}
+
+    /**
+     * Push the value for the key at idx, or nil.
+     */
+    virtual void index(lua_State* L, int idx) const = 0;
+
+    /**
+     * The number of entries.
+     */
+    virtual size_t size() const = 0;
+
+    /**
+     * Push the key and value of the nth entry, from 0.
+     * @return  false, pushing nothing, if n is past the end.
+     */
+    virtual bool entry(lua_State* L, size_t n) const = 0;
+  };
+
+  /**
+   * A dataset over a custom structure.
+   */
+  explicit dataset(std::shared_ptr<const source> s) : source_ { std::move(s) }
+  {}
+
+  /**
+   * A dataset over a vector, indexed from 1 like a lua array.
+   */
+  template <typename T> static dataset of(std::shared_ptr<const std::vector<T>> values) {
+    return dataset(std::make_shared<vector_source<T>>(std::move(values)));
+  }
+
+  /**
+   * A dataset over a hash map.
+   */
+  template <typename TKey, typename TValue>
+  static dataset of(std::shared_ptr<const std::unordered_map<TKey, TValue>> map) {
+    return dataset(std::make_shared<map_source<TKey, TValue>>(std::move(map)));
+  }
+
+  /**
+   * The number of entries.
+   */
+  size_t size() const { return source_->size(); }
+
+  /**
+   * Let lua code read the dataset.
+   * @param v  The location to put the dataset at.
+   */
+  void bind(const var& v) const {
+    stack_guard g(v.L);
+    v.push_parent_key();
+    new (lua_newuserdata(v.L, sizeof(handle))) handle(source_);
+    push_metatable(v.L);
+    lua_setmetatable(v.L, -2);
+    lua_settable(v.L, v.lineage_.size() == 1 ? v.virtual_index_ : -3);
+  }
+
+ private:
+  typedef std::shared_ptr<const source> handle;
+
+  // Reads a key of type T, if the lua value is one.
+  template <typename T, class Enable = void> struct key {
+    static bool get(lua_State* L, int idx, T& out) {
+      out = val::direct_popper<T>::get(L, idx);
+      return true;
+    }
+  };
+
+  template <typename T> struct key<T, typename std::enable_if<std::is_arithmetic<T>::value>::type> {
+    static bool get(lua_State* L, int idx, T& out) {
+      if (lua_type(L, idx) != LUA_TNUMBER) {
+        return false;
+      }
+      lua_Number n = lua_tonumber(L, idx);
+      if (n != n || n < (lua_Number) std::numeric_limits<T>::lowest() || !(n < limit())) {
+        return false;
+      }
+      out = (T) n;
+      return (lua_Number) out == n;
+    }
+
+    // The first value past max().  For integers it's a power of two, so it's
+    // exact even where max() itself rounds up, as 64-bit limits do.
+    static lua_Number limit() {
+      typedef std::numeric_limits<T> limits;
+      return limits::is_integer ? std::ldexp((lua_Number) 1, limits::digits)
+                                : std::nextafter((lua_Number) limits::max(), (lua_Number) limits::infinity());
+    }
+  };
+
+  template <typename T> struct key<T, typename std::enable_if<std::is_same<T, std::string>::value>::type> {
+    static bool get(lua_State* L, int idx, T& out) {
+      if (lua_type(L, idx) != LUA_TSTRING) {
+        return false;
+      }
+      size_t size;
+      const char* str = lua_tolstring(L, idx, &size);
+      out.assign(str, size);
+      return true;
+    }
+  };
+
+  template <typename T> struct vector_source : source {
+    explicit vector_source(std::shared_ptr<const std::vector<T>> values) : values { std::move(values) }
+    {}
+
+    void index(lua_State* L, int idx) const override {
+      lua_Number i = lua_type(L, idx) == LUA_TNUMBER ? lua_tonumber(L, idx) : 0;
+      if (i >= 1 && i <= values->size() && i == std::floor(i)) {
+        val::pusher<T>::push(L, (*values)[(size_t) i - 1]);
+      } else {
+        lua_pushnil(L);
+      }
+    }
+
+    size_t size() const override { return values->size(); }
+
+    bool entry(lua_State* L, size_t n) const override {
+      if (n >= values->size()) {
+        return false;
+      }
+      lua_pushnumber(L, (lua_Number)(n + 1));
+      val::pusher<T>::push(L, (*values)[n]);
+      return true;
+    }
+
+    std::shared_ptr<const std::vector<T>> values;
+  };
+
+  // Iterates through a vector of the map's entries, made once, since
+  // stepping an unordered_map to the nth entry is linear.
+  template <typename TKey, typename TValue> struct map_source : source {
+    typedef std::unordered_map<TKey, TValue> map_type;
+
+    explicit map_source(std::shared_ptr<const map_type> map) : map { std::move(map) } {
+      entries.reserve(this->map->size());
+      for (auto& e : *this->map) {
+        entries.push_back(&e);
+      }
+    }
+
+    void index(lua_State* L, int idx) const override {
+      TKey k;
+      if (!key<TKey>::get(L, idx, k)) {
+        lua_pushnil(L);
+        return;
+      }
+      auto found = map->find(k);
+      if (found == map->end()) {
+        lua_pushnil(L);
+      } else {
+        val::pusher<TValue>::push(L, found->second);
+      }
+    }
+
+    size_t size() const override { return map->size(); }
+
+    bool entry(lua_State* L, size_t n) const override {
+      if (n >= entries.size()) {
+        return false;
+      }
+      val::pusher<TKey>::push(L, entries[n]->first);
+      val::pusher<TValue>::push(L, entries[n]->second);
+      return true;
+    }
+
+    std::shared_ptr<const map_type> map;
+    std::vector<const typename map_type::value_type*> entries;
+  };
+
+  static const source& self(lua_State* L) {
+    return **static_cast<handle*>(luaL_checkudata(L, 1, metatable()));
+  }
+
+  static const char* metatable() { return "luapp11.dataset"; }
+
+  static int collect(lua_State* L) {
+    static_cast<handle*>(lua_touserdata(L, 1))->~handle();
+    return 0;
+  }
+
+  static int index(lua_State* L) {
+    self(L).index(L, 2);
+    return 1;
+  }
+
+  static int length(lua_State* L) {
+    lua_pushnumber(L, (lua_Number) self(L).size());
+    return 1;
+  }
+
+  static int read_only(lua_State* L) { return luaL_error(L, "Tried to assign to a read-only dataset."); }
+
+  // The iterator, with the dataset and the next position as upvalues.
+  static int next(lua_State* L) {
+    const source& s = **static_cast<handle*>(lua_touserdata(L, lua_upvalueindex(1)));
+    size_t n = (size_t) lua_tonumber(L, lua_upvalueindex(2));
+    if (!s.entry(L, n)) {
+      return 0;
+    }
+    lua_pushnumber(L, (lua_Number)(n + 1));
+    lua_replace(L, lua_upvalueindex(2));
+    return 2;
+  }
+
+  static int iterate(lua_State* L) {
+    self(L);
+    lua_pushvalue(L, 1);
+    lua_pushnumber(L, 0);
+    lua_pushcclosure(L, &next, 2);
+    return 1;
+  }
+
+  // One metatable per state, shared by every dataset bound in it.
+  static void push_metatable(lua_State* L) {
+    if (luaL_newmetatable(L, metatable()) == 0) {
+      return;
+    }
+    const luaL_Reg methods[] = {
+      { "__gc", &collect },
+      { "__index", &index },
+      { "__newindex", &read_only },
+      { "__len", &length },
+      { "__call", &iterate },
+      { "__pairs", &iterate },
+      { nullptr, nullptr }
+    };
+    luaL_register(L, nullptr, methods);
+  }
+
+  handle source_;
+};
+
+}
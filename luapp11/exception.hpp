@@ -5,6 +5,11 @@
 #include <sstream>
 
 namespace luapp11 {
+
+namespace detail {
+class parallel;
+}
+
 class exception : public std::exception {
  public:
   const char* what() const noexcept override { return what_.c_str(); }
@@ -65,8 +70,16 @@ class exception : public std::exception {
   friend class error;
   friend class var;
   friend class val;
-  friend class global;
+  friend class state;
   template <typename T> friend class result;
+  template <typename TSig> friend class function;
+  friend class coroutine;
+  friend class bundle;
+  friend class watcher;
+  friend class channel;
+  friend class broadcast;
+  friend class executor;
+  friend class detail::parallel;
 };
 
 class error {
@@ -79,7 +92,10 @@ class error {
     runtime = LUA_ERRRUN,
     memory = LUA_ERRMEM,
     error = LUA_ERRERR,
-    syntax = LUA_ERRSYNTAX
+    syntax = LUA_ERRSYNTAX,
+    file = LUA_ERRFILE,
+    timeout = -1,
+    cancelled = -2
   };
 
   const type error_type() const { return type_; }
@@ -102,13 +118,28 @@ class error {
   error(int t, std::string message, lua_State* L) : type_ { (type) t }
   , message_ { message }
   {
-    if (lua_isstring(L, -1)) {
+    if (lua_touserdata(L, -1) == sentinel(type::timeout)) {
+      type_ = type::timeout;
+      lua_message_ = "Execution budget exceeded.";
+      lua_pop(L, 1);
+    } else if (lua_touserdata(L, -1) == sentinel(type::cancelled)) {
+      type_ = type::cancelled;
+      lua_message_ = "Execution cancelled.";
+      lua_pop(L, 1);
+    } else if (lua_isstring(L, -1)) {
       lua_message_ = lua_tostring(L, -1);
       lua_pop(L, 1);
     }
     stack_ = exception::stackdump(L);
   }
 
+  // The values a budget raises to stop lua code, mapped back to their types
+  // when the error is caught.
+  static void* sentinel(type t) {
+    static char timeout, cancelled;
+    return t == type::timeout ? &timeout : &cancelled;
+  }
+
   type type_;
   std::string message_;
   std::string lua_message_;
@@ -116,9 +147,15 @@ class error {
 
   friend class var;
   friend class val;
-  friend class global;
+  friend class state;
   template <typename T> friend class result;
-  friend error do_chunk(const std::string& str);
-  friend error do_file(const std::string& path);
+  friend class coroutine;
+  friend class budget;
+  friend class bytecode_store;
+  friend class bundle;
+  friend class watcher;
+  friend class detail::parallel;
+  friend error dump_file(const std::string& path, std::string& bytecode, bool strip);
+  friend error compile_file(const std::string& path, const std::string& out, bool strip);
 };
 }
\ No newline at end of file
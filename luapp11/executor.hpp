@@ -0,0 +1,248 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace luapp11 {
+
+/**
+ * Runs lua function calls on a set of worker threads, each with its own lua state.  Each worker keeps its jobs in its
+ * own queue, and a worker with nothing to do steals jobs from the others, so many small jobs balance across cores.
+ *
+ * <pre>
+ *   executor pool(std::thread::hardware_concurrency(), [](state& s) { s.do_file("scripts/jobs.lua"); });
+ *   auto f = pool.submit<int>("score", user_id);
+ *   int score = f.get().value();
+ * </pre>
+ *
+ * Jobs submitted from inside a job go on that worker's own queue.  A job only sees the globals of the state it runs
+ * on, so anything jobs share has to be set up in every state by the initializer.
+ *
+ * Arguments are copied into the job as c++ values and pushed onto the worker's state when the job runs.  They
+ * aren't serialized, so they can be anything with a pusher, but not lua values which belong to another state.
+ */
+class executor {
+ public:
+  struct stats {
+    size_t submitted;
+    size_t completed;
+    // Jobs taken from another worker's queue.
+    size_t stolen;
+    // Jobs which threw, rather than returning an error in their result.
+    size_t failed;
+  };
+
+  /**
+   * Start the workers.
+   * @param workers  The number of worker threads and states.  At least one is started.
+   */
+  explicit executor(size_t workers) : executor(workers, [](state&) {})
+  {}
+
+  /**
+   * Start the workers.
+   * @param workers  The number of worker threads and states.  At least one is started, since
+   *                 hardware_concurrency() may be 0.
+   * @param init     Called with each worker's state before it runs any jobs, to add bindings and load scripts.
+   */
+  template <typename TInit> executor(size_t workers, TInit init) : next_ { 0 }
+  , pending_ { 0 }
+  , queued_ { 0 }
+  , submitted_ { 0 }
+  , completed_ { 0 }
+  , stolen_ { 0 }
+  , failed_ { 0 }
+  , stop_ { false }
+  {
+    workers = std::max<size_t>(workers, 1);
+    for (size_t i = 0; i < workers; i++) {
+      workers_.emplace_back(new worker());
+      init(workers_.back()->lua);
+    }
+    for (size_t i = 0; i < workers; i++) {
+      workers_[i]->thread = std::thread(&executor::run, this, i);
+    }
+  }
+
+  executor(const executor&) = delete;
+  executor& operator=(const executor&) = delete;
+
+  /**
+   * Finishes every submitted job, then stops the workers.
+   */
+  ~executor() {
+    wait();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& w : workers_) {
+      w->thread.join();
+    }
+  }
+
+  /**
+   * Call a global lua function on some worker.
+   * @param function  The name of the global function.
+   * @param args      The arguments, copied into the job.
+   * @return          The result of the call.  Holds the exception if the call threw, e.g. it isn't a function.
+   */
+  template <typename TOut, typename ... TArgs>
+  std::future<result<TOut>> submit(const std::string& function, TArgs ... args) {
+    auto promise = std::make_shared<std::promise<result<TOut>>>();
+    auto future = promise->get_future();
+    push([=](state& s) {
+      try {
+        promise->set_value(s[function].template invoke<TOut>(args ...));
+      } catch (...) {
+        promise->set_exception(std::current_exception());
+        throw;
+      }
+    });
+    return future;
+  }
+
+  /**
+   * Call a global lua function on some worker, and hand the result to a callback on that worker's thread.
+   * @param callback  Called with the result<TOut> of the call.  Not called if the call threw.
+   * @param function  The name of the global function.
+   * @param args      The arguments, copied into the job.
+   */
+  template <typename TOut, typename TCallback, typename ... TArgs>
+  void post(TCallback callback, const std::string& function, TArgs ... args) {
+    push([=](state& s) { callback(s[function].template invoke<TOut>(args ...)); });
+  }
+
+  /**
+   * Wait until every job submitted so far has run.  Can't be called from a job, which would wait for itself.
+   */
+  void wait() {
+    if (current().first == this) {
+      throw exception("Tried to wait on an executor from one of its own jobs.");
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() { return pending_ == 0; });
+  }
+
+  /**
+   * The number of worker threads.
+   */
+  size_t size() const { return workers_.size(); }
+
+  stats get_stats() const { return stats { submitted_, completed_, stolen_, failed_ }; }
+
+ private:
+  typedef std::function<void(state&)> job;
+
+  struct worker {
+    state lua;
+    std::mutex mutex;
+    std::deque<job> jobs;
+    std::thread thread;
+  };
+
+  // The executor and worker the current thread runs jobs for, if any.
+  static std::pair<executor*, size_t>& current() {
+    static thread_local std::pair<executor*, size_t> c { nullptr, 0 };
+    return c;
+  }
+
+  void push(job j) {
+    // Counted before it's visible, so a worker can't take it first.  A
+    // worker woken early spins until it appears.
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_++;
+      queued_++;
+    }
+    submitted_++;
+    size_t target = current().first == this ? current().second : next_++ % workers_.size();
+    {
+      std::lock_guard<std::mutex> lock(workers_[target]->mutex);
+      workers_[target]->jobs.push_back(std::move(j));
+    }
+    wake_.notify_one();
+  }
+
+  // Newest job first from the worker's own queue, for cache locality.
+  bool pop(size_t index, job& j) {
+    worker& w = *workers_[index];
+    std::lock_guard<std::mutex> lock(w.mutex);
+    if (w.jobs.empty()) {
+      return false;
+    }
+    j = std::move(w.jobs.back());
+    w.jobs.pop_back();
+    return true;
+  }
+
+  // Oldest job first from the other workers' queues.
+  bool steal(size_t index, job& j) {
+    for (size_t i = 1; i < workers_.size(); i++) {
+      worker& w = *workers_[(index + i) % workers_.size()];
+      std::lock_guard<std::mutex> lock(w.mutex);
+      if (!w.jobs.empty()) {
+        j = std::move(w.jobs.front());
+        w.jobs.pop_front();
+        stolen_++;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void run(size_t index) {
+    current() = std::make_pair(this, index);
+    worker& w = *workers_[index];
+    while (true) {
+      job j;
+      if (pop(index, j) || steal(index, j)) {
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          queued_--;
+        }
+        try {
+          j(w.lua);
+        } catch (...) {
+          failed_++;
+        }
+        completed_++;
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--pending_ == 0) {
+          done_.notify_all();
+        }
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [this]() { return stop_ || queued_ != 0; });
+      if (stop_ && queued_ == 0) {
+        return;
+      }
+    }
+  }
+
+  std::vector<std::unique_ptr<worker>> workers_;
+  std::atomic<size_t> next_;
+  size_t pending_;
+  size_t queued_;
+  std::atomic<size_t> submitted_;
+  std::atomic<size_t> completed_;
+  std::atomic<size_t> stolen_;
+  std::atomic<size_t> failed_;
+  bool stop_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+};
+
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+namespace luapp11 {
+
+namespace detail {
+template <typename T, class Enable = void> struct ctype {
+  static_assert(std::is_void<T>::value,
+                "Only arithmetic, pointer and void types can cross the ffi.");
+  static std::string name() { return "void"; }
+};
+
+template <typename T>
+struct ctype<T, typename std::enable_if<std::is_same<T, bool>::value>::type> {
+  static std::string name() { return "bool"; }
+};
+
+template <typename T>
+struct ctype<T, typename std::enable_if<std::is_same<T, char>::value>::type> {
+  static std::string name() { return "char"; }
+};
+
+template <typename T>
+struct ctype<T,
+             typename std::enable_if<std::is_integral<T>::value &&
+                                     !std::is_same<T, bool>::value &&
+                                     !std::is_same<T, char>::value>::type> {
+  static std::string name() {
+    return std::string(std::is_signed<T>::value ? "int" : "uint") +
+           std::to_string(sizeof(T) * 8) + "_t";
+  }
+};
+
+template <typename T>
+struct ctype<T, typename std::enable_if<std::is_same<T, float>::value>::type> {
+  static std::string name() { return "float"; }
+};
+
+template <typename T>
+struct ctype<T, typename std::enable_if<std::is_same<T, double>::value>::type> {
+  static std::string name() { return "double"; }
+};
+
+template <typename T>
+struct ctype<T, typename std::enable_if<std::is_pointer<T>::value>::type> {
+  static std::string name() {
+    return std::is_same<T, const char*>::value
+               ? "const char *"
+               : std::is_same<T, char*>::value
+                     ? "char *"
+                     : std::is_const<typename std::remove_pointer<T>::type>::value
+                           ? "const void *"
+                           : "void *";
+  }
+};
+
+inline std::string ctype_list() { return ""; }
+
+template <typename TArg, typename ... TArgs>
+std::string ctype_list(TArg*, TArgs* ... rest) {
+  return ctype<TArg>::name() + (sizeof ...(TArgs) ? ", " : "") +
+         ctype_list(rest ...);
+}
+}
+
+/**
+ * A c++ function exposed to lua as a LuaJIT ffi function pointer.  Unlike a lua_CFunction, calls through the ffi
+ * can be compiled into JIT traces.  Only functions whose arguments and return type are arithmetic, pointers, or
+ * void can be bound this way, and the function must not throw or call back into lua.  Falls back to fn when the
+ * ffi library is not available.  64-bit integers can be passed in but not returned, since the ffi returns them as
+ * cdata rather than numbers; bind such functions with fn.  Lua strings convert to const char* parameters only; a
+ * char* parameter takes an ffi char buffer, e.g. ffi.new("char[?]", n).
+ *
+ *     global["add"] = ffi_fn<decltype(&add), &add>();
+ *     global["add"] = LUAPP11_FFI_FN(add);
+ */
+template <typename TRet, typename ... TArgs, TRet(*f)(TArgs ...)>
+struct ffi_fn<TRet(*)(TArgs ...), f> {
+  static_assert(!std::is_integral<TRet>::value || sizeof(TRet) < 8,
+                "The ffi returns 64-bit integers as cdata; bind the function with fn instead.");
+
+  /**
+   * The ffi type of the function pointer.  e.g. "int32_t (*)(int32_t, int32_t)"
+   */
+  static std::string pointer_type() {
+    return detail::ctype<TRet>::name() + " (*)(" +
+           detail::ctype_list((TArgs*) nullptr ...) + ")";
+  }
+
+  /**
+   * An ffi.cdef declaration for the function under the given name.  Only useful for functions which are
+   * exported with C linkage so that they can be found through ffi.C.
+   */
+  static std::string declaration(const std::string& name) {
+    return detail::ctype<TRet>::name() + " " + name + "(" +
+           detail::ctype_list((TArgs*) nullptr ...) + ");";
+  }
+
+ private:
+  // Pushes ffi.cast(pointer_type(), f) -0, +1 on success, -0, +0 otherwise.
+  static bool push_cdata(lua_State* L) {
+    lua_getglobal(L, "require");
+    lua_pushstring(L, "ffi");
+    if (lua_pcall(L, 1, 1, 0) != 0 || !lua_istable(L, -1)) {
+      lua_pop(L, 1);
+      return false;
+    }
+    lua_getfield(L, -1, "cast");
+    lua_pushstring(L, pointer_type().c_str());
+    lua_pushlightuserdata(L, (void*)f);
+    if (lua_pcall(L, 2, 1, 0) != 0) {
+      lua_pop(L, 2);
+      return false;
+    }
+    lua_remove(L, -2);
+    return true;
+  }
+
+  friend class val;
+};
+
+}
+
+#define LUAPP11_FFI_FN(f) ::luapp11::ffi_fn<decltype(&f), &f>()
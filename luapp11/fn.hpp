@@ -0,0 +1,45 @@
+#pragma once
+
+namespace luapp11 {
+
+/**
+ * A c++ function bound at compile time.  Because the function is a template parameter, calling it from lua goes
+ * through a dedicated lua_CFunction with no upvalue lookup, and each argument is converted directly from the lua
+ * stack rather than through a val.
+ *
+ *     global["add"] = fn<decltype(&add), &add>();
+ *     global["add"] = LUAPP11_FN(add);
+ */
+template <typename TRet, typename ... TArgs, TRet(*f)(TArgs ...)>
+struct fn<TRet(*)(TArgs ...), f> {
+  /**
+   * The lua_CFunction which lua calls.
+   */
+  static int call(lua_State* L) {
+    if (lua_gettop(L) != sizeof ...(TArgs)) {
+      return luaL_error(
+          L, "C++ function invoked with the wrong number of arguments.");
+    }
+    try {
+      return invoke(L,
+                    typename detail::build_indices<sizeof ...(TArgs)>::type());
+    }
+    catch (std::exception& e) {
+      lua_pushstring(L, e.what());
+    }
+    return lua_error(L);
+  }
+
+ private:
+  template <int ... Is> static int invoke(lua_State* L, detail::indices<Is ...>) {
+    return val::returner<typename std::decay<TRet>::type>::call(
+        L,
+        f,
+        val::direct_popper<typename std::decay<TArgs>::type>::get(L, Is + 1)
+        ...);
+  }
+};
+
+}
+
+#define LUAPP11_FN(f) ::luapp11::fn<decltype(&f), &f>()
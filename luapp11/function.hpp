@@ -0,0 +1,68 @@
+#pragma once
+
+#include <memory>
+
+#include "luapp11/internal/reference.hpp"
+
+namespace luapp11 {
+
+template <typename TSig> class function;
+
+/**
+ * A handle to a lua function with a fixed signature.  The function is looked up once, when the handle is made,
+ * and held in the lua registry so each call is only a registry lookup, the argument pushes, and lua_pcall.
+ *
+ *     function<int(int)> hook(global["hooks"]["on_request"]);
+ *     int status = hook(42);
+ *
+ * A handle may outlive its lua state, e.g. a static holding a function from the global state, and is then safe to
+ * destroy.  Calling it after the state is closed throws.
+ */
+template <typename TOut, typename ... TArgs> class function<TOut(TArgs ...)> {
+ public:
+  /**
+   * Resolves the function at a place in the lua environment.
+   * @param v  The location of the function.
+   */
+  explicit function(const var& v) : L { v.L }
+  {
+    stack_guard g(L);
+    v.push();
+    if (!lua_isfunction(L, -1)) {
+      throw exception("Tried to make a function from a non-function.", L);
+    }
+    ref_ = std::make_shared<detail::reference>(L);
+  }
+
+  function(const function& other) = default;
+  function(function && other) = default;
+  function& operator=(const function& other) = default;
+  function& operator=(function && other) = default;
+
+  /**
+   * Call the function.
+   * @param args  The arguments to the call.
+   * @return      The result of the invocation.
+   */
+  template <typename ... TParams>
+  result<TOut> operator()(TParams && ... params) const {
+    static_assert(sizeof ...(TParams) == sizeof ...(TArgs),
+                  "Wrong number of arguments to lua function.");
+    if (ref_->closed()) {
+      throw exception("Tried to call a function whose lua state is closed.");
+    }
+    stack_guard g(L);
+    ref_->push();
+    int in_order[] = { 0, (val::pusher<typename std::decay<TArgs>::type>::push(
+                               L, std::forward<TParams>(params)),
+                           0) ... };
+    (void) in_order;
+    return var::caller<TOut>::pcall(L, sizeof ...(TArgs));
+  }
+
+ private:
+  lua_State* L;
+  std::shared_ptr<detail::reference> ref_;
+};
+
+}
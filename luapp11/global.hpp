@@ -1,50 +1,75 @@
 #pragma once
 
+#ifndef LUAPP11_NO_GLOBAL
+
 namespace luapp11 {
 
-class global {
+/**
+ * The lua state shared by the whole program, for when one is enough.  Every translation unit sees the same state,
+ * which is made the first time it's used and closed when the program exits.  Define LUAPP11_NO_GLOBAL to leave it
+ * out and only use explicit states.
+ */
+class global_state : public state {
  public:
-  global() : L { luaL_newstate() }
-  {
-    luaL_openlibs(L);
-    lua_atpanic(L, &panic);
+  static global_state& instance() {
+    static global_state g;
+    return g;
   }
 
-  var operator[](val key) const { return var(L, LUA_GLOBALSINDEX, key); }
-
  private:
-  static int panic(lua_State* L) { throw luapp11::exception("lua panic", L); }
+  global_state() = default;
+};
+
+/**
+ * Stands for the global state wherever a state is taken: global["x"], budget b(global, ...).  It holds nothing and
+ * needs no initialization at run time, so it's safe to use from static initializers in any translation unit.
+ */
+class global_ref {
+ public:
+  /**
+   * A global variable in the global state.
+   * @param key  The name of the variable.
+   */
+  var operator[](val key) const { return global_state::instance()[key]; }
+
+  /**
+   * Execute a string as lua in the global scope.  Its return values are dropped.
+   * @param  str The lua code to execute.
+   * @return     The error (if any) which occured while executing.
+   */
+  error do_chunk(const std::string& str) const { return global_state::instance().do_chunk(str); }
+
+  /**
+   * Execute a lua file in the global scope.  Its return values are dropped.
+   * @param  path The location of the file on disk.
+   * @return      The error (if any) which occured while executing.
+   */
+  error do_file(const std::string& path) const { return global_state::instance().do_file(path); }
 
-  lua_State* L;
+  /**
+   * The underlying lua_State.
+   */
+  lua_State* lua() const { return global_state::instance().lua(); }
 
-  friend error do_chunk(const std::string& str);
-  friend error do_file(const std::string& path);
+  operator const state&() const { return global_state::instance(); }
 };
 
-static global global;
+constexpr global_ref global {};
 
-inline error do_chunk(const std::string& str) {
-  int loadError = luaL_loadstring(global.L, str.c_str());
-  if (loadError != 0) {
-    return error(loadError, "Error loading chunk.", global.L);
-  }
-  int runError = lua_pcall(global.L, 0, LUA_MULTRET, 0);
-  if (runError != 0) {
-    return error(runError, "Error running chunk.", global.L);
-  }
-  return error();
-}
+/**
+ * Execute a string as lua in the global scope of the global state.
+ * @param  str The lua code to execute.
+ * @return     The error (if any) which occured while executing.
+ */
+inline error do_chunk(const std::string& str) { return global.do_chunk(str); }
+
+/**
+ * Execute a lua file in the global scope of the global state.
+ * @param  path The location of the file on disk.
+ * @return      The error (if any) which occured while executing.
+ */
+inline error do_file(const std::string& path) { return global.do_file(path); }
 
-inline error do_file(const std::string& path) {
-  int loadError = luaL_loadfile(global.L, path.c_str());
-  if (loadError != 0) {
-    return error(loadError, "Error loading chunk.", global.L);
-  }
-  int runError = lua_pcall(global.L, 0, LUA_MULTRET, 0);
-  if (runError != 0) {
-    return error(runError, "Error running chunk.", global.L);
-  }
-  return error();
 }
 
-}
\ No newline at end of file
+#endif
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "luapp11/bytecode.hpp"
+#include "luapp11/internal/lazy.hpp"
+
+namespace luapp11 {
+namespace detail {
+
+// Deep copies values from one lua state to another, or within one state.
+// Tables and functions reached more than once are copied once, so shared
+// structure and cycles come out the same.  Copies made so far are kept in a
+// table on the destination stack until the copy is done.
+class copier {
+ public:
+  copier(lua_State* from, lua_State* to, bool functions) : from { from }
+  , to { to }
+  , functions { functions }
+  , failed { nullptr }
+  , seen_ { 0 }
+  {}
+
+  // Pushes a copy of the value at an absolute index in from onto to.  On
+  // failure pushes nothing, leaves both stacks as they were, and says what
+  // couldn't be copied in failed.
+  bool copy(int idx) {
+    int from_top = lua_gettop(from), to_top = lua_gettop(to);
+    if (!lua_checkstack(to, 2)) {
+      failed = "value, out of stack space";
+      return false;
+    }
+    lua_newtable(to);
+    seen_ = lua_gettop(to);
+    copies_.clear();
+    upvalues_.clear();
+    if (!value(idx)) {
+      lua_settop(to, to_top);
+      lua_settop(from, from_top);
+      return false;
+    }
+    lua_remove(to, seen_);
+    return true;
+  }
+
+  lua_State* from;
+  lua_State* to;
+  bool functions;
+  const char* failed;
+
+ private:
+  bool value(int idx) {
+    switch (lua_type(from, idx)) {
+      case LUA_TNIL:
+        lua_pushnil(to);
+        return true;
+      case LUA_TBOOLEAN:
+        lua_pushboolean(to, lua_toboolean(from, idx));
+        return true;
+      case LUA_TNUMBER:
+        lua_pushnumber(to, lua_tonumber(from, idx));
+        return true;
+      case LUA_TSTRING: {
+        size_t size;
+        const char* str = lua_tolstring(from, idx, &size);
+        lua_pushlstring(to, str, size);
+        return true;
+      }
+      case LUA_TLIGHTUSERDATA:
+        lua_pushlightuserdata(to, lua_touserdata(from, idx));
+        return true;
+      case LUA_TTABLE:
+        return shared(idx) || table(idx);
+      case LUA_TFUNCTION:
+        return shared(idx) || function(idx);
+      default:
+        failed = lua_typename(from, lua_type(from, idx));
+        return false;
+    }
+  }
+
+  // Pushes the copy already made of a table or function, if there is one.
+  bool shared(int idx) {
+    auto found = copies_.find(lua_topointer(from, idx));
+    if (found == copies_.end()) {
+      return false;
+    }
+    lua_rawgeti(to, seen_, found->second);
+    return true;
+  }
+
+  // Remembers the copy on top of to as the copy of the value at idx, before
+  // its contents are copied, so a cycle back to it finds it.
+  int remember(int idx) {
+    int slot = (int) copies_.size() + 1;
+    copies_[lua_topointer(from, idx)] = slot;
+    lua_pushvalue(to, -1);
+    lua_rawseti(to, seen_, slot);
+    return slot;
+  }
+
+  bool table(int idx) {
+    if (!lua_checkstack(from, 4) || !lua_checkstack(to, 4)) {
+      failed = "table, nested too deeply";
+      return false;
+    }
+    if (!materialize(from, idx)) {
+      failed = "table, which failed to fill itself in";
+      return false;
+    }
+    // Counted first so the copy is allocated at its final size.
+    int length = (int) lua_objlen(from, idx), count = 0;
+    lua_pushnil(from);
+    while (lua_next(from, idx) != 0) {
+      count++;
+      lua_pop(from, 1);
+    }
+    lua_createtable(to, length, count > length ? count - length : 0);
+    remember(idx);
+    int copy = lua_gettop(to);
+    lua_pushnil(from);
+    while (lua_next(from, idx) != 0) {
+      int top = lua_gettop(from);
+      if (!value(top - 1) || !value(top)) {
+        return false;
+      }
+      lua_rawset(to, copy);
+      lua_pop(from, 1);
+    }
+    if (lua_getmetatable(from, idx)) {
+      // Removed by index rather than popped, since from and to can be the
+      // same stack.
+      int meta = lua_gettop(from);
+      if (!value(meta)) {
+        return false;
+      }
+      lua_setmetatable(to, copy);
+      lua_remove(from, meta);
+    }
+    return true;
+  }
+
+  // Lua functions are copied as bytecode, then given copies of their
+  // upvalues.  An upvalue shared by closures is joined rather than copied
+  // again.  C functions can't be copied: LuaJIT's builtins aren't plain
+  // lua_CFunctions.
+  bool function(int idx) {
+    if (lua_iscfunction(from, idx)) {
+      failed = "C function";
+      return false;
+    }
+    if (!functions) {
+      failed = "function";
+      return false;
+    }
+    std::string bytecode;
+    lua_pushvalue(from, idx);
+    lua_dump(from, &append_bytecode, &bytecode);
+    lua_pop(from, 1);
+    if (luaL_loadbuffer(to, bytecode.data(), bytecode.size(), "=copy") != 0) {
+      lua_pop(to, 1);
+      failed = "function";
+      return false;
+    }
+    int slot = remember(idx);
+    int copy = lua_gettop(to);
+    for (int i = 1; lua_getupvalue(from, idx, i) != nullptr; i++) {
+      int up = lua_gettop(from);
+      void* id = lua_upvalueid(from, idx, i);
+      auto found = upvalues_.find(id);
+      if (found != upvalues_.end()) {
+        lua_rawgeti(to, seen_, found->second.first);
+        lua_upvaluejoin(to, copy, i, lua_gettop(to), found->second.second);
+        lua_pop(to, 1);
+      } else {
+        upvalues_[id] = std::make_pair(slot, i);
+        if (!value(up)) {
+          return false;
+        }
+        lua_setupvalue(to, copy, i);
+      }
+      lua_remove(from, up);
+    }
+    return true;
+  }
+
+  int seen_;
+  std::unordered_map<const void*, int> copies_;
+  // Upvalues copied so far, as the slot of their function's copy and their
+  // index in it.
+  std::unordered_map<void*, std::pair<int, int>> upvalues_;
+};
+
+}
+}
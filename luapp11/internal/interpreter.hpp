@@ -0,0 +1,85 @@
+#pragma once
+
+#include "luapp11/internal/state_local.hpp"
+
+namespace luapp11 {
+namespace detail {
+
+// Keeps the JIT off while anything which relies on count hooks is running,
+// since hooks don't run inside compiled code.  The JIT mode belongs to the
+// whole lua state, so holds are counted per state: the first flushes compiled
+// code and turns the JIT off, and the last turns it back on if it was on.
+class interpreter {
+ public:
+  explicit interpreter(lua_State*) : holds_ { 0 }
+  , restore_ { false }
+  {}
+
+  // Holds the JIT off while alive, unless made inactive.
+  class hold {
+   public:
+    hold(lua_State* L, bool active) : L { L }
+    , interpreter_ { active ? &state_local<interpreter>(L) : nullptr }
+    {
+      if (interpreter_ != nullptr) {
+        interpreter_->acquire(L);
+      }
+    }
+
+    ~hold() {
+      if (interpreter_ != nullptr) {
+        interpreter_->release(L);
+      }
+    }
+
+    hold(const hold&) = delete;
+    hold& operator=(const hold&) = delete;
+
+   private:
+    lua_State* L;
+    interpreter* interpreter_;
+  };
+
+ private:
+  void acquire(lua_State* L) {
+    if (holds_++ != 0) {
+      return;
+    }
+    // Turning the JIT off doesn't stop traces already compiled from running.
+    restore_ = jit_on(L);
+    luaJIT_setmode(L, 0, LUAJIT_MODE_ENGINE | LUAJIT_MODE_FLUSH);
+    luaJIT_setmode(L, 0, LUAJIT_MODE_ENGINE | LUAJIT_MODE_OFF);
+  }
+
+  void release(lua_State* L) {
+    if (--holds_ == 0 && restore_) {
+      luaJIT_setmode(L, 0, LUAJIT_MODE_ENGINE | LUAJIT_MODE_ON);
+    }
+  }
+
+  // Asks jit.status.  L may be a suspended coroutine, which can't call
+  // anything, so then it's asked on a new thread.
+  static bool jit_on(lua_State* L) {
+    int top = lua_gettop(L);
+    lua_State* T = lua_status(L) == 0 ? L : lua_newthread(L);
+    int t_top = lua_gettop(T);
+    bool on = true;
+    lua_getfield(T, LUA_REGISTRYINDEX, "_LOADED");
+    lua_getfield(T, -1, "jit");
+    if (lua_istable(T, -1)) {
+      lua_getfield(T, -1, "status");
+      if (lua_isfunction(T, -1) && lua_pcall(T, 0, 1, 0) == 0) {
+        on = lua_toboolean(T, -1) != 0;
+      }
+    }
+    lua_settop(T, t_top);
+    lua_settop(L, top);
+    return on;
+  }
+
+  int holds_;
+  bool restore_;
+};
+
+}
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+namespace luapp11 {
+namespace detail {
+
+// Tables which fill themselves in on first use, like a lazily applied
+// broadcast, keep a function which fills them in under this key in their
+// metatable.  Code which reads a table's contents directly rather than
+// through its fields, like serializing or copying it, calls it first.
+inline void* lazy_key() {
+  static const char key = 0;
+  return (void*)&key;
+}
+
+// Fills in the table at an absolute index if it's lazy.  Returns false if
+// filling it in failed.  Needs 4 free stack slots.
+inline bool materialize(lua_State* L, int idx) {
+  if (!lua_getmetatable(L, idx)) {
+    return true;
+  }
+  lua_pushlightuserdata(L, lazy_key());
+  lua_rawget(L, -2);
+  if (!lua_isfunction(L, -1)) {
+    lua_pop(L, 2);
+    return true;
+  }
+  lua_pushvalue(L, idx);
+  bool ok = lua_pcall(L, 1, 0, 0) == 0;
+  lua_pop(L, ok ? 1 : 2);
+  return ok;
+}
+
+}
+}
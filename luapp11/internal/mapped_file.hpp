@@ -0,0 +1,125 @@
+#pragma once
+
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace luapp11 {
+namespace detail {
+
+// A read only view of a whole file, unmapped when it goes out of scope.
+// Empty files and files which can't be opened have no data.  Reading a page
+// of a file which has since been truncated raises SIGBUS, so only map files
+// which won't change while they're mapped, like bundles.
+struct mapped_file {
+  explicit mapped_file(const std::string& path) : data { nullptr }
+  , size { 0 }
+  , opened { false }
+  {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+      opened = true;
+      size = st.st_size;
+      if (size != 0) {
+        void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+          opened = false;
+          size = 0;
+        } else {
+          madvise(p, size, MADV_SEQUENTIAL);
+          data = static_cast<const char*>(p);
+        }
+      }
+    }
+    close(fd);
+  }
+
+  ~mapped_file() {
+    if (data != nullptr) {
+      munmap(const_cast<char*>(data), size);
+    }
+  }
+
+  mapped_file(const mapped_file&) = delete;
+  mapped_file& operator=(const mapped_file&) = delete;
+
+  const char* data;
+  size_t size;
+  bool opened;
+};
+
+// Hands lua_load the whole buffer as a single chunk.
+struct whole_reader {
+  const char* data;
+  size_t size;
+
+  static const char* read(lua_State*, void* ud, size_t* size) {
+    whole_reader* r = static_cast<whole_reader*>(ud);
+    *size = r->size;
+    r->size = 0;
+    return *size == 0 ? nullptr : r->data;
+  }
+};
+
+// Reads a whole file into a buffer, sized once from its length.  Scripts are
+// read rather than mapped, since they may be rewritten while they load, e.g.
+// by an editor while a watcher reloads them.
+inline bool read_whole(const std::string& path, std::string& out) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  bool ok = fstat(fd, &st) == 0;
+  if (ok) {
+    out.resize(st.st_size);
+    size_t done = 0;
+    while (done < out.size()) {
+      ssize_t n = ::read(fd, &out[done], out.size() - done);
+      if (n <= 0) {
+        ok = n == 0;
+        break;
+      }
+      done += n;
+    }
+    // A file truncated while being read just ends sooner.
+    out.resize(done);
+  }
+  close(fd);
+  return ok;
+}
+
+// Loads a script or bytecode file like luaL_loadfile, but in one read and
+// one piece.  Pushes the compiled chunk, or the error message.
+inline int load_whole(lua_State* L, const std::string& path) {
+  std::string file;
+  if (!read_whole(path, file)) {
+    lua_pushstring(L, ("cannot open " + path).c_str());
+    return LUA_ERRFILE;
+  }
+  whole_reader r { file.data(), file.size() };
+  // Skip a #! line, but keep its newline so line numbers still match.
+  // Bytecode has no line numbers to keep, and has to start with its
+  // signature.
+  if (r.size != 0 && r.data[0] == '#') {
+    while (r.size != 0 && r.data[0] != '\n') {
+      r.data++;
+      r.size--;
+    }
+    if (r.size > 1 && r.data[1] == LUA_SIGNATURE[0]) {
+      r.data++;
+      r.size--;
+    }
+  }
+  return lua_load(L, &whole_reader::read, &r, ("@" + path).c_str());
+}
+
+}
+}
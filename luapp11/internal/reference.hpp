@@ -0,0 +1,53 @@
+#pragma once
+
+#include <memory>
+
+#include "luapp11/internal/state_local.hpp"
+
+namespace luapp11 {
+namespace detail {
+
+// Lives exactly as long as its lua state.  Things which hold on to a state
+// keep a weak pointer to the token, so they can tell once it's closed.
+struct lifetime {
+  explicit lifetime(lua_State*) : token { std::make_shared<char>(0) }
+  {}
+
+  std::shared_ptr<char> token;
+};
+
+// A value anchored in the lua registry.  Takes the value off the top of the
+// stack -1, +0, -
+//
+// A reference may outlive its lua state, e.g. one held by a static which is
+// destroyed after the state is closed.  It then leaves the freed state alone.
+struct reference {
+  explicit reference(lua_State* state) : L { state }
+  , ref { luaL_ref(state, LUA_REGISTRYINDEX) }
+  , open_ { state_local<lifetime>(state).token }
+  {}
+
+  ~reference() {
+    if (!closed()) {
+      luaL_unref(L, LUA_REGISTRYINDEX, ref);
+    }
+  }
+
+  reference(const reference&) = delete;
+  reference& operator=(const reference&) = delete;
+
+  // Puts the value on the top of the stack -0, +1, -
+  void push() const { lua_rawgeti(L, LUA_REGISTRYINDEX, ref); }
+
+  // Whether the lua state has been closed.
+  bool closed() const { return open_.expired(); }
+
+  lua_State* L;
+  int ref;
+
+ private:
+  std::weak_ptr<char> open_;
+};
+
+}
+}
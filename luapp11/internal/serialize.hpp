@@ -0,0 +1,362 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+#include "luapp11/internal/lazy.hpp"
+
+namespace luapp11 {
+namespace detail {
+
+// A compact binary form of lua values, for moving them between lua states
+// which can't share a lua_State.  Each value is a tag byte and its payload:
+//
+//   nil, false, true     nothing
+//   integer              a zigzag varint, for integral numbers up to 2^53
+//   number               the 8 bytes of a double
+//   string               a varint length and the bytes
+//   table                varint array and hash sizes, the array values from
+//                        1, then the other keys and values
+//   ref                  a varint count of tables before the one referred to
+//   lightuserdata        the 8 bytes of the pointer
+//
+// A table reached twice is written once and referred to after, so shared
+// structure and cycles come out the same.  Metatables are left out, and
+// functions, full userdata, and coroutines can't be encoded.  Numbers are
+// in the byte order of the machine which encoded them.
+enum class wire : char {
+  nil,
+  boolean_false,
+  boolean_true,
+  integer,
+  number,
+  string,
+  table,
+  ref,
+  lightuserdata
+};
+
+// Tables nested deeper than this are neither encoded nor decoded.
+const int max_wire_depth = 1000;
+
+class encoder {
+ public:
+  explicit encoder(lua_State* L) : L { L }
+  , failed { nullptr }
+  , depth_ { 0 }
+  {}
+
+  // Appends the value at an absolute index to out.  On failure says what
+  // couldn't be encoded in failed, and leaves out partly written.
+  bool encode(int idx, std::string& out) {
+    out_ = &out;
+    depth_ = 0;
+    tables_.clear();
+    int top = lua_gettop(L);
+    bool ok = value(idx);
+    lua_settop(L, top);
+    return ok;
+  }
+
+  lua_State* L;
+  const char* failed;
+
+ private:
+  bool value(int idx) {
+    switch (lua_type(L, idx)) {
+      case LUA_TNIL:
+        put(wire::nil);
+        return true;
+      case LUA_TBOOLEAN:
+        put(lua_toboolean(L, idx) ? wire::boolean_true : wire::boolean_false);
+        return true;
+      case LUA_TNUMBER:
+        number(lua_tonumber(L, idx));
+        return true;
+      case LUA_TSTRING: {
+        size_t size;
+        const char* str = lua_tolstring(L, idx, &size);
+        put(wire::string);
+        varint(size);
+        out_->append(str, size);
+        return true;
+      }
+      case LUA_TLIGHTUSERDATA: {
+        void* p = lua_touserdata(L, idx);
+        put(wire::lightuserdata);
+        out_->append(reinterpret_cast<const char*>(&p), sizeof(p));
+        return true;
+      }
+      case LUA_TTABLE:
+        return table(idx);
+      default:
+        failed = lua_typename(L, lua_type(L, idx));
+        return false;
+    }
+  }
+
+  // Whole numbers go as varints, except -0, which would lose its sign.
+  void number(double n) {
+    if (n == std::floor(n) && std::fabs(n) <= 9007199254740992.0 && (n != 0 || !std::signbit(n))) {
+      int64_t i = (int64_t) n;
+      put(wire::integer);
+      varint(((uint64_t) i << 1) ^ (uint64_t)(i >> 63));
+      return;
+    }
+    put(wire::number);
+    out_->append(reinterpret_cast<const char*>(&n), sizeof(n));
+  }
+
+  bool table(int idx) {
+    auto found = tables_.find(lua_topointer(L, idx));
+    if (found != tables_.end()) {
+      put(wire::ref);
+      varint(found->second);
+      return true;
+    }
+    if (depth_ >= max_wire_depth || !lua_checkstack(L, 4)) {
+      failed = "table, nested too deeply";
+      return false;
+    }
+    if (!materialize(L, idx)) {
+      failed = "table, which failed to fill itself in";
+      return false;
+    }
+    depth_++;
+    size_t id = tables_.size();
+    tables_[lua_topointer(L, idx)] = id;
+    // Counted first so the decoder can allocate the table at its final size.
+    size_t length = lua_objlen(L, idx), count = 0, in_array = 0;
+    lua_pushnil(L);
+    while (lua_next(L, idx) != 0) {
+      lua_pop(L, 1);
+      count++;
+      in_array += array_key(-1, length);
+    }
+    put(wire::table);
+    varint(length);
+    varint(count - in_array);
+    for (size_t i = 1; i <= length; i++) {
+      lua_rawgeti(L, idx, (int) i);
+      if (!value(lua_gettop(L))) {
+        return false;
+      }
+      lua_pop(L, 1);
+    }
+    lua_pushnil(L);
+    while (lua_next(L, idx) != 0) {
+      int top = lua_gettop(L);
+      if (!array_key(top - 1, length) && (!value(top - 1) || !value(top))) {
+        return false;
+      }
+      lua_pop(L, 1);
+    }
+    depth_--;
+    return true;
+  }
+
+  // Whether a key was written with the array values.
+  bool array_key(int idx, size_t length) {
+    if (lua_type(L, idx) != LUA_TNUMBER) {
+      return false;
+    }
+    double n = lua_tonumber(L, idx);
+    return n >= 1 && n <= length && n == std::floor(n);
+  }
+
+  void put(wire w) { out_->push_back((char) w); }
+
+  void varint(uint64_t n) {
+    while (n >= 0x80) {
+      out_->push_back((char)(n | 0x80));
+      n >>= 7;
+    }
+    out_->push_back((char) n);
+  }
+
+  std::string* out_;
+  int depth_;
+  std::unordered_map<const void*, size_t> tables_;
+};
+
+class decoder {
+ public:
+  decoder(lua_State* L, const char* data, size_t size) : L { L }
+  , p_ { data }
+  , end_ { data + size }
+  , tables_ { 0 }
+  , count_ { 0 }
+  {}
+
+  // Pushes the decoded value.  On failure pushes nothing.  Tables are kept in
+  // a table below the value until it's done, for refs to find.
+  //
+  // With into, the encoded value must be a table, and its fields are set in
+  // the existing table at that absolute index, which is pushed.
+  bool decode(int into = 0) {
+    int top = lua_gettop(L);
+    if (!lua_checkstack(L, 2)) {
+      return false;
+    }
+    lua_newtable(L);
+    tables_ = lua_gettop(L);
+    count_ = 0;
+    bool ok;
+    if (into == 0) {
+      ok = value(0);
+    } else {
+      ok = p_ != end_ && static_cast<wire>(*p_++) == wire::table && table(0, into);
+    }
+    if (!ok || p_ != end_) {
+      lua_settop(L, top);
+      return false;
+    }
+    lua_remove(L, tables_);
+    return true;
+  }
+
+ private:
+  bool value(int depth) {
+    if (p_ == end_) {
+      return false;
+    }
+    switch (static_cast<wire>(*p_++)) {
+      case wire::nil:
+        lua_pushnil(L);
+        return true;
+      case wire::boolean_false:
+        lua_pushboolean(L, 0);
+        return true;
+      case wire::boolean_true:
+        lua_pushboolean(L, 1);
+        return true;
+      case wire::integer: {
+        uint64_t z;
+        if (!varint(z)) {
+          return false;
+        }
+        lua_pushnumber(L, (lua_Number)(int64_t)((z >> 1) ^ (~(z & 1) + 1)));
+        return true;
+      }
+      case wire::number: {
+        double n;
+        if (!raw(&n, sizeof(n))) {
+          return false;
+        }
+        lua_pushnumber(L, n);
+        return true;
+      }
+      case wire::string: {
+        uint64_t size;
+        if (!varint(size) || size > (uint64_t)(end_ - p_)) {
+          return false;
+        }
+        lua_pushlstring(L, p_, size);
+        p_ += size;
+        return true;
+      }
+      case wire::lightuserdata: {
+        void* ptr;
+        if (!raw(&ptr, sizeof(ptr))) {
+          return false;
+        }
+        lua_pushlightuserdata(L, ptr);
+        return true;
+      }
+      case wire::ref: {
+        uint64_t id;
+        if (!varint(id) || id >= count_) {
+          return false;
+        }
+        lua_rawgeti(L, tables_, (int) id + 1);
+        return true;
+      }
+      case wire::table:
+        return table(depth);
+      default:
+        return false;
+    }
+  }
+
+  bool table(int depth, int into = 0) {
+    uint64_t length, hash;
+    // Every entry takes at least a byte, which bounds what a bad size can
+    // make us allocate.
+    if (depth >= max_wire_depth || !lua_checkstack(L, 4) || !varint(length) || !varint(hash) ||
+        length > (uint64_t)(end_ - p_) || hash > (uint64_t)(end_ - p_)) {
+      return false;
+    }
+    if (into == 0) {
+      lua_createtable(L, (int) length, (int) hash);
+    } else {
+      lua_pushvalue(L, into);
+    }
+    lua_pushvalue(L, -1);
+    lua_rawseti(L, tables_, (int) ++count_);
+    int table = lua_gettop(L);
+    for (uint64_t i = 1; i <= length; i++) {
+      if (!value(depth + 1)) {
+        return false;
+      }
+      lua_rawseti(L, table, (int) i);
+    }
+    for (uint64_t i = 0; i < hash; i++) {
+      if (!value(depth + 1) || !value(depth + 1) || lua_isnil(L, -2) ||
+          (lua_isnumber(L, -2) && lua_tonumber(L, -2) != lua_tonumber(L, -2))) {
+        return false;
+      }
+      lua_rawset(L, table);
+    }
+    return true;
+  }
+
+  bool raw(void* out, size_t size) {
+    if ((size_t)(end_ - p_) < size) {
+      return false;
+    }
+    std::memcpy(out, p_, size);
+    p_ += size;
+    return true;
+  }
+
+  bool varint(uint64_t& n) {
+    n = 0;
+    for (int shift = 0; shift < 64 && p_ != end_; shift += 7) {
+      unsigned char b = static_cast<unsigned char>(*p_++);
+      n |= (uint64_t)(b & 0x7f) << shift;
+      if ((b & 0x80) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  lua_State* L;
+  const char* p_;
+  const char* end_;
+  int tables_;
+  uint64_t count_;
+};
+
+// Encodes the value at an index, appending to out.  Returns what couldn't be
+// encoded, or nullptr.
+inline const char* serialize(lua_State* L, int idx, std::string& out) {
+  encoder e(L);
+  if (idx < 0 && idx > LUA_REGISTRYINDEX) {
+    idx = lua_gettop(L) + idx + 1;
+  }
+  return e.encode(idx, out) ? nullptr : e.failed;
+}
+
+// Pushes the value encoded in data.  Returns false, pushing nothing, if the
+// data is malformed.  With into, decodes a table's fields into the table at
+// that absolute index.
+inline bool deserialize(lua_State* L, const char* data, size_t size, int into = 0) {
+  return decoder(L, data, size).decode(into);
+}
+
+}
+}
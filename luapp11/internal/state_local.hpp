@@ -0,0 +1,35 @@
+#pragma once
+
+#include <new>
+
+namespace luapp11 {
+namespace detail {
+
+template <typename T> int destroy_state_local(lua_State* L) {
+  static_cast<T*>(lua_touserdata(L, 1))->~T();
+  return 0;
+}
+
+// A single T per lua state, stored as a full userdata in the registry and
+// destroyed when the state is closed.  T is constructed from the lua_State
+// which first asks for it.
+template <typename T> T& state_local(lua_State* L) {
+  static const char key = 0;
+  lua_pushlightuserdata(L, (void*)&key);
+  lua_rawget(L, LUA_REGISTRYINDEX);
+  T* local = static_cast<T*>(lua_touserdata(L, -1));
+  lua_pop(L, 1);
+  if (local == nullptr) {
+    lua_pushlightuserdata(L, (void*)&key);
+    local = new (lua_newuserdata(L, sizeof(T))) T(L);
+    lua_createtable(L, 0, 1);
+    lua_pushcfunction(L, &destroy_state_local<T>);
+    lua_setfield(L, -2, "__gc");
+    lua_setmetatable(L, -2);
+    lua_rawset(L, LUA_REGISTRYINDEX);
+  }
+  return *local;
+}
+
+}
+}
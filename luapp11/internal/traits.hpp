@@ -1,5 +1,8 @@
 #pragma once
 
+#include <functional>
+#include <type_traits>
+
 namespace luapp11 {
 namespace detail {
 template <typename T, class Enable = void>
@@ -19,18 +22,29 @@ struct remove_function_ptr_member_type<TOut(T::*)(TArgs ...) const,
   typedef TOut(type)(TArgs ...);
 };
 
-template <typename T, class Enable = void>
-struct convert_functor_to_std_function {
-  typedef T type;
+template <typename T, class Enable = void> struct functor_signature {
+  static const bool value = false;
 };
 
 template <typename T>
-struct convert_functor_to_std_function<
+struct functor_signature<
     T,
     typename std::enable_if<std::is_member_function_pointer<
         decltype(&T::operator())>::value>::type> {
-  typedef std::function<typename remove_function_ptr_member_type<
-      decltype(&T::operator())>::type> type;
+  static const bool value = true;
+  typedef typename remove_function_ptr_member_type<
+      decltype(&T::operator())>::type type;
+};
+
+template <int ... Is> struct indices {
+};
+
+template <int N, int ... Is>
+struct build_indices : build_indices<N - 1, N - 1, Is ...> {
+};
+
+template <int ... Is> struct build_indices<0, Is ...> {
+  typedef indices<Is ...> type;
 };
 }
 }
\ No newline at end of file
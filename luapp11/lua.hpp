@@ -4,10 +4,28 @@ extern "C" {
 #include "lua.h"
 #include "lualib.h"
 #include "lauxlib.h"
+#include "luajit.h"
 }
 
 #include "luapp11/exception.hpp"
 #include "luapp11/result.hpp"
 #include "luapp11/val.hpp"
+#include "luapp11/fn.hpp"
+#include "luapp11/ffi.hpp"
+#include "luapp11/chunk_cache.hpp"
+#include "luapp11/bytecode.hpp"
+#include "luapp11/bundle.hpp"
+#include "luapp11/watcher.hpp"
+#include "luapp11/channel.hpp"
 #include "luapp11/var.hpp"
+#include "luapp11/function.hpp"
+#include "luapp11/coroutine.hpp"
+#include "luapp11/scheduler.hpp"
+#include "luapp11/budget.hpp"
+#include "luapp11/state.hpp"
+#include "luapp11/state_pool.hpp"
+#include "luapp11/parallel.hpp"
+#include "luapp11/broadcast.hpp"
+#include "luapp11/dataset.hpp"
+#include "luapp11/executor.hpp"
 #include "luapp11/global.hpp"
\ No newline at end of file
@@ -0,0 +1,337 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "luapp11/internal/reference.hpp"
+#include "luapp11/internal/state_local.hpp"
+
+namespace luapp11 {
+namespace detail {
+
+// Calls f on each element of a partition in place.  Looping in lua rather
+// than calling into lua once per element from c++ lets the JIT compile the
+// loop and the call together.
+struct parallel_kernel {
+  explicit parallel_kernel(lua_State* L) {
+    luaL_loadstring(L, "local f, items, n = ... "
+                       "for i = 1, n do items[i] = f(items[i]) end "
+                       "return items");
+    map.reset(new reference(L));
+  }
+
+  std::unique_ptr<reference> map;
+};
+
+// Threads kept for every parallel call, so a call doesn't pay to start its
+// own.  Started on first use, one per core besides the caller's.
+class parallel_threads {
+ public:
+  static parallel_threads& instance() {
+    static parallel_threads t;
+    return t;
+  }
+
+  ~parallel_threads() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& t : threads_) {
+      t.join();
+    }
+  }
+
+  size_t size() const { return threads_.size(); }
+
+  void post(std::function<void()> job) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      jobs_.push_back(std::move(job));
+    }
+    wake_.notify_one();
+  }
+
+ private:
+  parallel_threads() : stop_ { false } {
+    size_t n = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    for (size_t i = 0; i < n; i++) {
+      threads_.emplace_back(&parallel_threads::loop, this);
+    }
+  }
+
+  void loop() {
+    while (true) {
+      std::function<void()> job;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [this]() { return stop_ || !jobs_.empty(); });
+        if (jobs_.empty()) {
+          return;
+        }
+        job = std::move(jobs_.front());
+        jobs_.pop_front();
+      }
+      job();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::deque<std::function<void()>> jobs_;
+  bool stop_;
+  std::vector<std::thread> threads_;
+};
+
+class parallel {
+ public:
+  template <typename TOut, typename TInputIt, typename TOutputIt>
+  static result<void> map(state_pool& pool, const std::string& function, TInputIt first, TInputIt last,
+                          TOutputIt out) {
+    size_t parts = partitions(pool, first, last);
+    std::vector<std::vector<TOut>> outs(parts);
+    std::vector<std::unique_ptr<error>> errors(parts);
+    run(pool, parts, [&](state& s, size_t p) {
+      lua_State* L = s.lua();
+      stack_guard g(L);
+      TInputIt from = first, to = first;
+      bounds(first, last, parts, p, from, to);
+      size_t n = std::distance(from, to);
+      state_local<parallel_kernel>(L).map->push();
+      push_function(L, function);
+      push_partition(L, from, to, n);
+      lua_pushinteger(L, (lua_Integer) n);
+      int err = lua_pcall(L, 3, 1, 0);
+      if (err != 0) {
+        errors[p].reset(new error(err, "Error calling lua method.", L));
+        return;
+      }
+      outs[p].reserve(n);
+      for (size_t i = 1; i <= n; i++) {
+        lua_rawgeti(L, -1, (int) i);
+        if (returned_nil<TOut>(L)) {
+          errors[p].reset(new error(LUA_ERRRUN, "Error calling lua method.", L));
+          return;
+        }
+        outs[p].push_back(val::popper<TOut>::get(L, -1));
+        lua_pop(L, 1);
+      }
+    });
+    for (auto& e : errors) {
+      if (e) {
+        return *e;
+      }
+    }
+    for (auto& o : outs) {
+      out = std::move(o.begin(), o.end(), out);
+    }
+    return result<void>();
+  }
+
+  template <typename TOut, typename TInputIt, typename TCombine>
+  static result<TOut> reduce(state_pool& pool, const std::string& function, TInputIt first, TInputIt last,
+                             TOut init, TCombine combine) {
+    size_t parts = partitions(pool, first, last);
+    std::vector<std::unique_ptr<TOut>> partials(parts);
+    std::vector<std::unique_ptr<error>> errors(parts);
+    run(pool, parts, [&](state& s, size_t p) {
+      lua_State* L = s.lua();
+      stack_guard g(L);
+      TInputIt from = first, to = first;
+      bounds(first, last, parts, p, from, to);
+      push_function(L, function);
+      push_partition(L, from, to, std::distance(from, to));
+      int err = lua_pcall(L, 1, 1, 0);
+      if (err != 0) {
+        errors[p].reset(new error(err, "Error calling lua method.", L));
+        return;
+      }
+      if (returned_nil<TOut>(L)) {
+        errors[p].reset(new error(LUA_ERRRUN, "Error calling lua method.", L));
+        return;
+      }
+      partials[p].reset(new TOut(val::popper<TOut>::get(L, -1)));
+    });
+    for (auto& e : errors) {
+      if (e) {
+        return *e;
+      }
+    }
+    for (auto& partial : partials) {
+      init = combine(init, *partial);
+    }
+    return init;
+  }
+
+ private:
+  // One partition per state, and none empty.
+  template <typename TInputIt>
+  static size_t partitions(const state_pool& pool, TInputIt first, TInputIt last) {
+    return std::min<size_t>(pool.size(), std::distance(first, last));
+  }
+
+  // Splits the range into parts runs whose lengths differ by at most one.
+  template <typename TInputIt>
+  static void bounds(TInputIt first, TInputIt last, size_t parts, size_t p, TInputIt& from, TInputIt& to) {
+    size_t size = std::distance(first, last);
+    size_t base = size / parts, extra = size % parts;
+    from = first;
+    std::advance(from, p * base + std::min(p, extra));
+    to = from;
+    std::advance(to, base + (p < extra ? 1 : 0));
+  }
+
+  // Whether the result on top of the stack is a nil which TOut can't hold,
+  // rather than letting it quietly become 0 or "".  If so it's replaced with
+  // the error message.
+  template <typename TOut> static bool returned_nil(lua_State* L) {
+    if (!lua_isnil(L, -1) || std::is_same<TOut, val>::value) {
+      return false;
+    }
+    lua_pop(L, 1);
+    lua_pushstring(L, "Parallel function returned nil.");
+    return true;
+  }
+
+  static void push_function(lua_State* L, const std::string& function) {
+    lua_getglobal(L, function.c_str());
+    if (!lua_isfunction(L, -1)) {
+      throw exception("Tried to invoke non-function.", L);
+    }
+  }
+
+  // Pushes a partition as an array table sized up front, so filling it never
+  // rehashes.
+  template <typename TInputIt> static void push_partition(lua_State* L, TInputIt from, TInputIt to, size_t n) {
+    typedef typename std::iterator_traits<TInputIt>::value_type TArg;
+    lua_createtable(L, (int) n, 0);
+    int i = 0;
+    for (; from != to; ++from) {
+      val::pusher<TArg>::push(L, *from);
+      lua_rawseti(L, -2, ++i);
+    }
+  }
+
+  // Runs each partition on a checked out state.  The calling thread and the
+  // kept threads take partitions until none are left, so a call finishes even
+  // if every kept thread is busy, e.g. with an outer parallel call.  The
+  // calling thread runs its partitions on a state it already holds, if any,
+  // so a caller holding a lease can't wait on itself.  Rethrows the first
+  // exception once all are done.
+  template <typename TPart> static void run(state_pool& pool, size_t parts, TPart part) {
+    if (parts == 0) {
+      return;
+    }
+    // Shared with the jobs posted to the kept threads, which may only get to
+    // run after every partition is done and this call has returned.  They
+    // then find nothing left to take, and never touch part.
+    struct batch {
+      std::atomic<size_t> next;
+      std::atomic<size_t> done;
+      size_t parts;
+      std::mutex mutex;
+      std::condition_variable finished;
+    };
+    auto b = std::make_shared<batch>();
+    b->next = 0;
+    b->done = 0;
+    b->parts = parts;
+    std::vector<std::exception_ptr> thrown(parts);
+    std::function<void(size_t)> work = [&](size_t p) {
+      try {
+        pool.use([&](state& s) { part(s, p); });
+      } catch (...) {
+        thrown[p] = std::current_exception();
+      }
+    };
+    std::function<void(size_t)>* w = &work;
+    auto take = [b, w]() {
+      for (size_t p; (p = b->next++) < b->parts;) {
+        (*w)(p);
+        if (++b->done == b->parts) {
+          std::lock_guard<std::mutex> lock(b->mutex);
+          b->finished.notify_all();
+        }
+      }
+    };
+    auto& threads = parallel_threads::instance();
+    for (size_t i = 1; i < parts && i <= threads.size(); i++) {
+      threads.post(take);
+    }
+    take();
+    {
+      std::unique_lock<std::mutex> lock(b->mutex);
+      b->finished.wait(lock, [&b]() { return b->done == b->parts; });
+    }
+    for (auto& t : thrown) {
+      if (t) {
+        std::rethrow_exception(t);
+      }
+    }
+  }
+};
+
+}
+
+/**
+ * Call a global lua function on every value in a range, with the range split across the states of a pool.  Each
+ * state gets one contiguous partition as a lua array, and calls the function on its elements in a lua loop the JIT
+ * can compile.  Results are written in the order of the input.  The partitions run on threads kept for every
+ * parallel call and on the calling thread.
+ *
+ * <pre>
+ *   state_pool pool(std::thread::hardware_concurrency(), [](state& s) { s.do_file("scripts/score.lua"); });
+ *   std::vector<double> scores;
+ *   parallel_map<double>(pool, "score", records.begin(), records.end(), std::back_inserter(scores));
+ * </pre>
+ *
+ * @param pool      The states to run on.  Uses as many states as there are values, up to all of them.
+ * @param function  The name of a global function defined in every state of the pool.
+ * @param first     The start of the range of arguments.
+ * @param last      The end of the range of arguments.
+ * @param out       Where to write the result of each call.
+ * @return          The result of the invocations.  Nothing is written to out if any partition failed.
+ */
+template <typename TOut, typename TInputIt, typename TOutputIt>
+result<void> parallel_map(state_pool& pool, const std::string& function, TInputIt first, TInputIt last,
+                          TOutputIt out) {
+  return detail::parallel::map<TOut>(pool, function, first, last, out);
+}
+
+/**
+ * Reduce a range with a global lua function, with the range split across the states of a pool.  The function is
+ * called once per partition with the partition as a lua array, and returns that partition's partial result.  The
+ * partials are then combined in c++, in the order of the input.
+ *
+ * <pre>
+ *   // function total(items) local t = 0 for i = 1, #items do t = t + items[i].amount end return t end
+ *   double sum = parallel_reduce(pool, "total", orders.begin(), orders.end(), 0.0, std::plus<double>()).value();
+ * </pre>
+ *
+ * @param pool      The states to run on.  Uses as many states as there are values, up to all of them.
+ * @param function  The name of a global function defined in every state of the pool.
+ * @param first     The start of the range of values.
+ * @param last      The end of the range of values.
+ * @param init      The value partials are combined into.  The result for an empty range.
+ * @param combine   Combines the result so far with the next partial: combine(TOut, TOut) -> TOut.
+ * @return          The combined result, or the error of the first partition which failed.
+ */
+template <typename TOut, typename TInputIt, typename TCombine>
+result<TOut> parallel_reduce(state_pool& pool, const std::string& function, TInputIt first, TInputIt last, TOut init,
+                             TCombine combine) {
+  return detail::parallel::reduce(pool, function, first, last, init, combine);
+}
+
+}
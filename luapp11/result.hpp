@@ -1,17 +1,47 @@
 #pragma once
 
+#include <new>
+#include <utility>
+
 namespace luapp11 {
 
 template <typename T> class result {
  public:
-  ~result() {}
+  ~result() {
+    if (success_) {
+      val_.~T();
+    } else {
+      err_.~error();
+    }
+  }
   result(const result& r) : success_ { r.success_ }
   {
     if (success_) {
-      val_ = r.val_;
+      new (&val_) T(r.val_);
     } else {
+      new (&err_) luapp11::error(r.err_);
+    }
+  }
+  // Assigns member to member.  When switching between a value and an error,
+  // the new member is copied before the old one is destroyed, so a copy
+  // which throws leaves this result as it was.
+  result& operator=(const result& r) {
+    if (success_ && r.success_) {
+      val_ = r.val_;
+    } else if (!success_ && !r.success_) {
       err_ = r.err_;
+    } else if (r.success_) {
+      T copy(r.val_);
+      err_.~error();
+      new (&val_) T(std::move(copy));
+      success_ = true;
+    } else {
+      luapp11::error copy(r.err_);
+      val_.~T();
+      new (&err_) luapp11::error(std::move(copy));
+      success_ = false;
     }
+    return *this;
   }
 
   bool success() const { return success_; }
@@ -54,6 +84,9 @@ template <typename T> class result {
     T val_;
   };
   friend class var;
+  friend class coroutine;
+  friend class scheduler;
+  friend class detail::parallel;
 };
 
 template <> class result<void> {
@@ -79,6 +112,9 @@ template <> class result<void> {
   bool success_;
   luapp11::error err_;
   friend class var;
+  friend class coroutine;
+  friend class scheduler;
+  friend class detail::parallel;
 };
 
 }
\ No newline at end of file
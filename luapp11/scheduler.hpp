@@ -0,0 +1,344 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace luapp11 {
+
+/**
+ * Runs many lua coroutines cooperatively on one lua state.  Ready tasks are resumed in order of deadline, then
+ * priority.  What a task yields decides when it runs next:
+ *
+ *     coroutine.yield()         -- run again on the next pass
+ *     coroutine.yield(0.25)     -- sleep for a quarter of a second
+ *     coroutine.yield(token)    -- park until the future behind a token from scheduler::await is ready
+ *
+ * A task finishes when its function returns or raises an error.  With set_slice, tasks which run too long
+ * without yielding are preempted and put back in the ready queue.
+ */
+class scheduler {
+ public:
+  typedef std::chrono::steady_clock clock;
+
+  struct stats {
+    // Queue depths.
+    size_t ready;
+    size_t sleeping;
+    size_t waiting;
+    // Tokens from await not yet yielded.
+    size_t tokens;
+
+    size_t resumes;
+    size_t completed;
+    size_t failed;
+
+    // How far past their deadlines tasks were resumed.
+    size_t late;
+    clock::duration max_lateness;
+    clock::duration total_lateness;
+  };
+
+  scheduler() : running_ { nullptr }
+  , slice_ { 0 }
+  , sequence_ { 0 }
+  , next_token_ { 1 }
+  , stats_()
+  {}
+
+  scheduler(const scheduler&) = delete;
+  scheduler& operator=(const scheduler&) = delete;
+
+  /**
+   * Start a task with no deadline.
+   * @param func  The location of the lua function to run.
+   * @param args  The arguments to the function.
+   */
+  template <typename ... TArgs> void spawn(const var& func, TArgs && ... args) {
+    spawn(clock::time_point::max(), 0, func, std::forward<TArgs>(args) ...);
+  }
+
+  /**
+   * Start a task.
+   * @param deadline  When the task should be finished by.  Earlier deadlines are resumed first.
+   * @param priority  Breaks ties between equal deadlines.  Higher priorities are resumed first.
+   * @param func      The location of the lua function to run.
+   * @param args      The arguments to the function.
+   */
+  template <typename ... TArgs>
+  void spawn(clock::time_point deadline,
+             int priority,
+             const var& func,
+             TArgs && ... args) {
+    auto t = std::make_shared<task>(func, deadline, priority);
+    t->start = [args ...](coroutine & co, int slice) {
+      return co.run(slice, args ...);
+    };
+    make_ready(t);
+  }
+
+  /**
+   * Get a token which a task can yield to park until a future is ready.  A token is dropped once its future is
+   * ready, or when the task which took it finishes without yielding it.  Yielding a dropped token parks nothing, so
+   * the task just runs again on the next pass.
+   * @param f  The future to wait on.
+   * @return   The token to hand to lua.
+   */
+  template <typename T> val await(std::shared_future<T> f) {
+    void* token = (void*)next_token_++;
+    tokens_[token] = [f]() {
+      return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    };
+    if (running_ != nullptr) {
+      running_->tokens.push_back(token);
+    }
+    return val(token);
+  }
+
+  /**
+   * Sets the most lua VM instructions a task may run per resume before it is preempted.
+   * @param instructions  The size of the slice.  0, the default, lets tasks run until they yield.
+   */
+  void set_slice(int instructions) { slice_ = instructions; }
+
+  /**
+   * Sets a handler which is called with the error of every task which fails.
+   */
+  void on_error(std::function<void(const error&)> handler) {
+    on_error_ = handler;
+  }
+
+  /**
+   * Wakes any tasks whose timers or futures are ready, then resumes every task which was ready, once each.
+   * @return  The number of tasks resumed.
+   */
+  size_t run_once() {
+    auto now = clock::now();
+    wake(now);
+    std::vector<std::shared_ptr<task>> batch;
+    while (!ready_.empty()) {
+      batch.push_back(ready_.top().t);
+      ready_.pop();
+    }
+    for (auto& t : batch) {
+      resume(t, now);
+    }
+    return batch.size();
+  }
+
+  /**
+   * Runs until every task has finished.  Sleeps while nothing is ready.
+   */
+  void run() {
+    while (!empty()) {
+      if (run_once() == 0 && ready_.empty()) {
+        idle();
+      }
+    }
+  }
+
+  /**
+   * Whether there are no tasks left.
+   */
+  bool empty() const {
+    return ready_.empty() && sleeping_.empty() && waiting_.empty();
+  }
+
+  stats get_stats() const {
+    stats s = stats_;
+    s.ready = ready_.size();
+    s.sleeping = sleeping_.size();
+    s.waiting = waiting_.size();
+    s.tokens = tokens_.size();
+    return s;
+  }
+
+ private:
+  struct task {
+    task(const var& func, clock::time_point d, int p) : co { func }
+    , deadline { d }
+    , priority { p }
+    , started { false }
+    {}
+
+    coroutine co;
+    std::function<int(coroutine&, int)> start;
+    clock::time_point deadline;
+    int priority;
+    bool started;
+    // Tokens from await which the task hasn't yielded yet.
+    std::vector<void*> tokens;
+  };
+
+  struct ready_entry {
+    std::shared_ptr<task> t;
+    uint64_t sequence;
+
+    // priority_queue puts the greatest first, so "less" means runs later.
+    bool operator<(const ready_entry& other) const {
+      if (t->deadline != other.t->deadline) {
+        return t->deadline > other.t->deadline;
+      }
+      if (t->priority != other.t->priority) {
+        return t->priority < other.t->priority;
+      }
+      return sequence > other.sequence;
+    }
+  };
+
+  struct sleeping_entry {
+    std::shared_ptr<task> t;
+    clock::time_point wake;
+
+    bool operator<(const sleeping_entry& other) const {
+      return wake > other.wake;
+    }
+  };
+
+  struct waiting_entry {
+    std::shared_ptr<task> t;
+    std::function<bool()> is_ready;
+  };
+
+  void make_ready(const std::shared_ptr<task>& t) {
+    ready_.push(ready_entry { t, sequence_++ });
+  }
+
+  void wake(clock::time_point now) {
+    while (!sleeping_.empty() && sleeping_.top().wake <= now) {
+      make_ready(sleeping_.top().t);
+      sleeping_.pop();
+    }
+    for (auto i = waiting_.begin(); i != waiting_.end();) {
+      if (i->is_ready()) {
+        make_ready(i->t);
+        i = waiting_.erase(i);
+      } else {
+        ++i;
+      }
+    }
+    // Tokens nobody has yielded yet, including those taken outside any task.
+    for (auto i = tokens_.begin(); i != tokens_.end();) {
+      if (i->second()) {
+        i = tokens_.erase(i);
+      } else {
+        ++i;
+      }
+    }
+  }
+
+  void resume(const std::shared_ptr<task>& t, clock::time_point now) {
+    if (now > t->deadline) {
+      auto lateness = now - t->deadline;
+      stats_.late++;
+      stats_.total_lateness += lateness;
+      if (lateness > stats_.max_lateness) {
+        stats_.max_lateness = lateness;
+      }
+    }
+
+    stats_.resumes++;
+    auto yielded = step(*t);
+    if (t->co.done()) {
+      for (void* token : t->tokens) {
+        tokens_.erase(token);
+      }
+    }
+    if (!yielded.success()) {
+      stats_.failed++;
+      if (on_error_) {
+        on_error_(yielded.error());
+      }
+    } else if (t->co.done()) {
+      stats_.completed++;
+    } else {
+      park(t, yielded.value());
+    }
+  }
+
+  // Resumes a task.  Only a number or a token yielded means anything to the
+  // scheduler, so anything else comes back as nil rather than converted.
+  result<val> step(task& t) {
+    // Lets await tell which task took a token.
+    struct running_guard {
+      task*& running;
+      task* previous;
+      ~running_guard() { running = previous; }
+    } g { running_, running_ };
+    running_ = &t;
+    int err;
+    if (t.started) {
+      err = t.co.run(slice_);
+    } else {
+      t.started = true;
+      auto start = std::move(t.start);
+      err = start(t.co, slice_);
+    }
+    if (err != 0 && err != LUA_YIELD) {
+      return t.co.failed<val>(err);
+    }
+    lua_State* thread = t.co.state_->thread.state;
+    val yielded;
+    if (lua_type(thread, 1) == LUA_TNUMBER) {
+      yielded = val(lua_tonumber(thread, 1));
+    } else if (lua_type(thread, 1) == LUA_TLIGHTUSERDATA) {
+      yielded = val(lua_touserdata(thread, 1));
+    }
+    lua_settop(thread, 0);
+    return yielded;
+  }
+
+  void park(const std::shared_ptr<task>& t, val yielded) {
+    if (yielded.type_ == val::type::number && yielded.num > 0 &&
+        yielded.num < max_delay()) {
+      auto delay = std::chrono::duration<double>(yielded.num);
+      sleeping_.push(sleeping_entry {
+        t, clock::now() + std::chrono::duration_cast<clock::duration>(delay)
+      });
+    } else if (yielded.type_ == val::type::lightuserdata &&
+               tokens_.count(yielded.ptr)) {
+      waiting_.push_back(waiting_entry { t, tokens_[yielded.ptr] });
+      tokens_.erase(yielded.ptr);
+      auto& owned = t->tokens;
+      owned.erase(std::remove(owned.begin(), owned.end(), yielded.ptr), owned.end());
+    } else {
+      make_ready(t);
+    }
+  }
+
+  // The longest sleep, in seconds, which can't overflow the clock.  NaN, zero
+  // and negative delays fail the checks against it too.
+  static double max_delay() {
+    return std::chrono::duration_cast<std::chrono::duration<double>>(
+               clock::duration::max()).count() / 2;
+  }
+
+  // Waits for the next timer, or briefly when only futures are pending.
+  void idle() {
+    auto until = clock::now() + std::chrono::milliseconds(1);
+    if (!sleeping_.empty() &&
+        (waiting_.empty() || sleeping_.top().wake < until)) {
+      until = sleeping_.top().wake;
+    }
+    std::this_thread::sleep_until(until);
+  }
+
+  std::priority_queue<ready_entry> ready_;
+  std::priority_queue<sleeping_entry> sleeping_;
+  std::vector<waiting_entry> waiting_;
+  std::map<void*, std::function<bool()>> tokens_;
+  std::function<void(const error&)> on_error_;
+  task* running_;
+  int slice_;
+  uint64_t sequence_;
+  uintptr_t next_token_;
+  stats stats_;
+};
+
+}
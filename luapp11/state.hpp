@@ -0,0 +1,116 @@
+#pragma once
+
+#include <string>
+#include <utility>
+
+namespace luapp11 {
+
+/**
+ * A lua state with the standard libraries open.  Closes the state when destroyed.  States are independent of each
+ * other, so each thread can run its own.
+ *
+ * <pre>
+ *   luapp11::state s;
+ *   s.do_chunk("x = 5");
+ *   int x = s["x"].get<int>();
+ * </pre>
+ *
+ * Moving a state keeps the vars taken from it valid.
+ */
+class state {
+ public:
+  state() : L { luaL_newstate() }
+  {
+    if (L == nullptr) {
+      throw exception("Unable to create lua state.");
+    }
+    luaL_openlibs(L);
+    lua_atpanic(L, &panic);
+  }
+
+  state(state && other) : L { other.L }
+  { other.L = nullptr; }
+
+  state& operator=(state && other) {
+    std::swap(L, other.L);
+    return *this;
+  }
+
+  state(const state&) = delete;
+  state& operator=(const state&) = delete;
+
+  ~state() {
+    if (L != nullptr) {
+      lua_close(L);
+    }
+  }
+
+  /**
+   * A global variable in this state.
+   * @param key  The name of the variable.
+   */
+  var operator[](val key) const { return var(L, LUA_GLOBALSINDEX, key); }
+
+  /**
+   * Execute a string as lua in the global scope.  Its return values are dropped.
+   * @param  str The lua code to execute.
+   * @return     The error (if any) which occured while executing.
+   */
+  error do_chunk(const std::string& str) const {
+    stack_guard g(L);
+    int loadError = detail::state_local<chunk_cache>(L).load(L, str);
+    if (loadError != 0) {
+      return error(loadError, "Error loading chunk.", L);
+    }
+    int runError = lua_pcall(L, 0, 0, 0);
+    if (runError != 0) {
+      return error(runError, "Error running chunk.", L);
+    }
+    return error();
+  }
+
+  /**
+   * Execute a lua file in the global scope.  Its return values are dropped.
+   * @param  path The location of the file on disk.
+   * @return      The error (if any) which occured while executing.
+   */
+  error do_file(const std::string& path) const {
+    stack_guard g(L);
+    int loadError = detail::state_local<bytecode_store>(L).load(L, path);
+    if (loadError != 0) {
+      return error(loadError, "Error loading chunk.", L);
+    }
+    int runError = lua_pcall(L, 0, 0, 0);
+    if (runError != 0) {
+      return error(runError, "Error running chunk.", L);
+    }
+    return error();
+  }
+
+  /**
+   * The underlying lua_State, for calling the lua C API directly.  Owned by this state.
+   */
+  lua_State* lua() const { return L; }
+
+ private:
+  static int panic(lua_State* L) { throw luapp11::exception("lua panic", L); }
+
+  lua_State* L;
+};
+
+inline budget::budget(const state& s, size_t instructions, clock::duration wall_time, bool interpret)
+    : budget(s.lua(), instructions, wall_time, interpret)
+{}
+
+inline chunk_cache& chunk_cache::of(const state& s) { return detail::state_local<chunk_cache>(s.lua()); }
+
+inline bytecode_store& bytecode_store::of(const state& s) { return detail::state_local<bytecode_store>(s.lua()); }
+
+inline void bundle::install(const state& s) const { install(s.lua()); }
+
+#ifdef __linux__
+inline watcher::watcher(const state& s) : watcher(s.lua())
+{}
+#endif
+
+}
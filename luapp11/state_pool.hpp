@@ -0,0 +1,307 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace luapp11 {
+
+/**
+ * A fixed set of lua states shared by worker threads.  A lua state can only be used by one thread at a time, so
+ * threads check a state out, use it, and check it back in.
+ *
+ * <pre>
+ *   state_pool pool(std::thread::hardware_concurrency(), [](state& s) {
+ *     s["log"] = LUAPP11_FN(log);
+ *     s.do_file("scripts/init.lua");
+ *   });
+ *   // on each worker thread
+ *   auto s = pool.checkout();
+ *   s["handle"].invoke<int>(request);
+ * </pre>
+ *
+ * With affinity on, a thread gets back the state it used last if it's free, so it keeps running on a state whose
+ * JIT traces and caches are warm for what that thread does.
+ */
+class state_pool {
+ public:
+  typedef std::chrono::steady_clock clock;
+
+  struct stats {
+    size_t size;
+    size_t in_use;
+
+    size_t checkouts;
+    // Checkouts which got the same state as that thread's last checkout.
+    size_t affinity_hits;
+
+    // Time spent waiting for a free state.
+    size_t waits;
+    clock::duration total_wait;
+    clock::duration max_wait;
+
+    // The fraction of state time spent checked out since the pool was made.
+    double utilization;
+  };
+
+  /**
+   * A checked out state.  Checked back in when destroyed.
+   */
+  class lease {
+   public:
+    lease(lease && other) : pool_ { other.pool_ }
+    , index_ { other.index_ }
+    { other.pool_ = nullptr; }
+
+    lease(const lease&) = delete;
+    lease& operator=(const lease&) = delete;
+
+    ~lease() {
+      if (pool_ != nullptr) {
+        pool_->checkin(index_);
+      }
+    }
+
+    /**
+     * Whether a state was checked out.  Only false from a try_checkout which found no free state.
+     */
+    explicit operator bool() const { return pool_ != nullptr; }
+
+    state& operator*() const { return pool_->states_[index_]; }
+    state* operator->() const { return &pool_->states_[index_]; }
+
+    /**
+     * A global variable in the checked out state.
+     * @param key  The name of the variable.
+     */
+    var operator[](val key) const { return pool_->states_[index_][key]; }
+
+    /**
+     * Which of the pool's states this is, from 0 to size() - 1.
+     */
+    size_t index() const { return index_; }
+
+   private:
+    lease(state_pool* pool, size_t index) : pool_ { pool }
+    , index_ { index }
+    {}
+
+    state_pool* pool_;
+    size_t index_;
+
+    friend class state_pool;
+  };
+
+  /**
+   * Create the states.
+   * @param size      The number of states.
+   * @param affinity  Give threads back the state they used last when it's free.
+   */
+  explicit state_pool(size_t size, bool affinity = true) : state_pool(size, [](state&) {}, affinity)
+  {}
+
+  /**
+   * Create and set up the states.
+   * @param size      The number of states.
+   * @param init      Called with each state before it can be checked out, to add bindings and load scripts.
+   * @param affinity  Give threads back the state they used last when it's free.
+   */
+  template <typename TInit>
+  state_pool(size_t size, TInit init, bool affinity = true) : states_(size)
+  , free_(size, true)
+  , since_(size)
+  , owners_(size)
+  , available_ { size }
+  , affinity_ { affinity }
+  , created_ { clock::now() }
+  , busy_ { clock::duration::zero() }
+  , stats_()
+  {
+    for (auto& s : states_) {
+      init(s);
+    }
+  }
+
+  state_pool(const state_pool&) = delete;
+  state_pool& operator=(const state_pool&) = delete;
+
+  /**
+   * Check out a state, waiting for one to be free.
+   */
+  lease checkout() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (available_ == 0) {
+      auto start = clock::now();
+      freed_.wait(lock, [this]() { return available_ != 0; });
+      auto waited = clock::now() - start;
+      stats_.waits++;
+      stats_.total_wait += waited;
+      if (waited > stats_.max_wait) {
+        stats_.max_wait = waited;
+      }
+    }
+    return lease(this, take());
+  }
+
+  /**
+   * Check out a state if one is free, without waiting.
+   * @return  The state, or an empty lease if none was free.
+   */
+  lease try_checkout() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (available_ == 0) {
+      return lease(nullptr, 0);
+    }
+    return lease(this, take());
+  }
+
+  /**
+   * Call a function with every state in the pool, checking each out in turn, in whatever order they come free.  Only
+   * one state is checked out at a time, so calls from many threads at once can't deadlock.  A state the calling
+   * thread already has checked out is used as it is.
+   * @param f  Called with each state: f(state&).
+   */
+  template <typename F> void for_each(F f) {
+    auto self = std::this_thread::get_id();
+    std::vector<bool> done(states_.size(), false);
+    for (size_t left = states_.size(); left > 0; left--) {
+      size_t index = states_.size();
+      bool held = false;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        freed_.wait(lock, [&]() {
+          for (size_t i = 0; i < states_.size(); i++) {
+            if (!done[i] && (free_[i] || owners_[i] == self)) {
+              index = i;
+              held = !free_[i];
+              return true;
+            }
+          }
+          return false;
+        });
+        if (!held) {
+          take(index);
+        }
+      }
+      lease l(held ? nullptr : this, index);
+      done[index] = true;
+      f(states_[index]);
+    }
+  }
+
+  /**
+   * Call a function with one state: one the calling thread already has checked out, or else the next free one, which
+   * is checked out for the call.  Unlike checkout, a thread holding a lease can't deadlock waiting on itself.
+   * @param f  Called with the state: f(state&).
+   */
+  template <typename F> void use(F f) {
+    auto self = std::this_thread::get_id();
+    size_t index = states_.size();
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      freed_.wait(lock, [&]() {
+        for (size_t i = 0; i < states_.size(); i++) {
+          if (!free_[i] && owners_[i] == self) {
+            index = i;
+            return true;
+          }
+        }
+        return available_ != 0;
+      });
+      if (index == states_.size()) {
+        index = take();
+        lock.unlock();
+        lease l(this, index);
+        f(states_[index]);
+        return;
+      }
+    }
+    f(states_[index]);
+  }
+
+  /**
+   * The number of states.
+   */
+  size_t size() const { return states_.size(); }
+
+  stats get_stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats s = stats_;
+    s.size = states_.size();
+    s.in_use = states_.size() - available_;
+    auto now = clock::now();
+    auto busy = busy_;
+    for (size_t i = 0; i < states_.size(); i++) {
+      if (!free_[i]) {
+        busy += now - since_[i];
+      }
+    }
+    std::chrono::duration<double> total = (now - created_) * states_.size();
+    s.utilization = total.count() > 0 ? std::chrono::duration<double>(busy).count() / total.count() : 0;
+    return s;
+  }
+
+ private:
+  // Picks a free state, with the lock held.
+  size_t take() {
+    size_t index = states_.size();
+    auto self = std::this_thread::get_id();
+    if (affinity_) {
+      auto last = last_.find(self);
+      if (last != last_.end() && free_[last->second]) {
+        index = last->second;
+        stats_.affinity_hits++;
+      }
+    }
+    for (size_t i = 0; index == states_.size(); i++) {
+      if (free_[i]) {
+        index = i;
+      }
+    }
+    if (affinity_) {
+      last_[self] = index;
+    }
+    take(index);
+    return index;
+  }
+
+  // Checks out a particular free state, with the lock held.
+  void take(size_t index) {
+    free_[index] = false;
+    owners_[index] = std::this_thread::get_id();
+    available_--;
+    stats_.checkouts++;
+    since_[index] = clock::now();
+  }
+
+  void checkin(size_t index) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      free_[index] = true;
+      owners_[index] = std::thread::id();
+      available_++;
+      busy_ += clock::now() - since_[index];
+    }
+    // Everyone, since for_each waits for particular states.
+    freed_.notify_all();
+  }
+
+  std::vector<state> states_;
+  std::vector<bool> free_;
+  std::vector<clock::time_point> since_;
+  // The thread each state is checked out to.
+  std::vector<std::thread::id> owners_;
+  size_t available_;
+  bool affinity_;
+  std::unordered_map<std::thread::id, size_t> last_;
+  clock::time_point created_;
+  clock::duration busy_;
+  stats stats_;
+  mutable std::mutex mutex_;
+  std::condition_variable freed_;
+};
+
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "luapp11/internal/stack_guard.hpp"
+#include "luapp11/internal/traits.hpp"
 #include "luapp11/exception.hpp"
 #include <memory>
 #include <utility>
@@ -14,6 +15,10 @@
 
 namespace luapp11 {
 
+template <typename F, F f> struct fn;
+template <typename F, F f> struct ffi_fn;
+template <typename TSig> class function;
+
 class val {
  public:
   val() : type_ { type::nil }
@@ -74,7 +79,9 @@ class val {
     }
   }
 
-  val(val && other) { swap(*this, other); }
+  val(val && other) : type_ { type::nil }
+  , ptr { nullptr }
+  { swap(*this, other); }
 
   template <typename T> T get() {
     switch (type_) {
@@ -283,6 +290,7 @@ class val {
         // }
       case type::thread:
         lua_pushthread(thread);
+        lua_xmove(thread, L, 1);
         break;
       case type::lightuserdata:
         lua_pushlightuserdata(L, ptr);
@@ -476,24 +484,105 @@ class val {
   struct popper<std::tuple<TArgs ...>, std::enable_if<true>::type> {
     static std::tuple<TArgs ...> get(lua_State* L, int idx) {
       stack_popper p(idx);
-      return std::tuple<TArgs ...>(p.get<TArgs>(L) ...);
+      return std::tuple<TArgs ...> { p.get<TArgs>(L) ... };
+    }
+  };
+
+  // Direct popping.  Reads a function argument straight off the stack without
+  // building an intermediate val.  Anything without a direct conversion falls
+  // back to the regular popper.
+  template <typename T, class Enable = void> struct direct_popper {
+    static T get(lua_State* L, int idx) { return popper<T>::get(L, idx); }
+  };
+
+  template <typename T>
+  struct direct_popper<T,
+                       typename std::enable_if<
+                           std::is_arithmetic<T>::value &&
+                           !std::is_same<T, bool>::value>::type> {
+    static T get(lua_State* L, int idx) { return (T) luaL_checknumber(L, idx); }
+  };
+
+  template <typename T>
+  struct direct_popper<
+      T, typename std::enable_if<std::is_same<T, bool>::value>::type> {
+    static T get(lua_State* L, int idx) { return lua_toboolean(L, idx) != 0; }
+  };
+
+  template <typename T>
+  struct direct_popper<
+      T, typename std::enable_if<std::is_same<T, std::string>::value>::type> {
+    static T get(lua_State* L, int idx) {
+      size_t len;
+      const char* str = luaL_checklstring(L, idx, &len);
+      return std::string(str, len);
     }
   };
 
-  // Counting
-  template <typename T, class Enable = void> struct counter {
-    static int count() { return 1; }
+  template <typename T>
+  struct direct_popper<
+      T, typename std::enable_if<std::is_same<T, const char*>::value>::type> {
+    static T get(lua_State* L, int idx) { return luaL_checkstring(L, idx); }
+  };
+
+  template <typename T>
+  struct direct_popper<
+      T, typename std::enable_if<std::is_pointer<T>::value &&
+                                 !std::is_same<T, const char*>::value>::type> {
+    static T get(lua_State* L, int idx) { return (T) lua_touserdata(L, idx); }
+  };
+
+  // Returning.  Calls a c++ function and pushes what it returns as lua return
+  // values.  void pushes nothing, tuples and pairs push one value per element.
+  template <typename T, class Enable = void> struct returner {
+    template <typename F, typename ... TParams>
+    static int call(lua_State* L, F&& func, TParams&& ... params) {
+      pusher<T>::push(L, func(std::forward<TParams>(params) ...));
+      return 1;
+    }
   };
 
   template <typename T>
-  struct counter<T,
-                 typename std::enable_if<std::is_same<T, void>::value>::type> {
-    static int count() { return 0; }
+  struct returner<T,
+                  typename std::enable_if<std::is_void<T>::value>::type> {
+    template <typename F, typename ... TParams>
+    static int call(lua_State* L, F&& func, TParams&& ... params) {
+      func(std::forward<TParams>(params) ...);
+      return 0;
+    }
   };
 
   template <typename ... TArgs>
-  struct counter<std::tuple<TArgs ...>, std::enable_if<true>::type> {
-    static int count() { return sizeof ...(TArgs); }
+  struct returner<std::tuple<TArgs ...>, std::enable_if<true>::type> {
+    template <typename F, typename ... TParams>
+    static int call(lua_State* L, F&& func, TParams&& ... params) {
+      luaL_checkstack(L, sizeof ...(TArgs), "Too many return values.");
+      push_each(L,
+                func(std::forward<TParams>(params) ...),
+                typename detail::build_indices<sizeof ...(TArgs)>::type());
+      return sizeof ...(TArgs);
+    }
+
+    template <int ... Is>
+    static void push_each(lua_State* L,
+                          const std::tuple<TArgs ...>& ret,
+                          detail::indices<Is ...>) {
+      int in_order[] = { 0, (pusher<typename std::decay<TArgs>::type>::push(
+                                 L, std::get<Is>(ret)),
+                             0) ... };
+      (void) in_order;
+    }
+  };
+
+  template <typename TFirst, typename TSecond>
+  struct returner<std::pair<TFirst, TSecond>, std::enable_if<true>::type> {
+    template <typename F, typename ... TParams>
+    static int call(lua_State* L, F&& func, TParams&& ... params) {
+      auto ret = func(std::forward<TParams>(params) ...);
+      pusher<typename std::decay<TFirst>::type>::push(L, ret.first);
+      pusher<typename std::decay<TSecond>::type>::push(L, ret.second);
+      return 2;
+    }
   };
 
   // Pushing
@@ -590,54 +679,77 @@ class val {
     static void push(lua_State* L, const T& v) { v.push(L); }
   };
 
-  template <typename TRet, typename ... TArgs>
-  struct pusher<std::function<TRet(TArgs ...)>, std::enable_if<true>::type> {
-    typedef std::function<TRet(TArgs ...)> f_type;
+  // Functors and lambdas are stored in place as their own type in a full
+  // userdata, invoked by reference, and destroyed by __gc.
+  template <typename T, typename TSig = typename detail::functor_signature<
+                            T>::type> struct functor_pusher {
+  };
+
+  template <typename T, typename TRet, typename ... TArgs>
+  struct functor_pusher<T, TRet(TArgs ...)> {
+    static_assert(std::alignment_of<T>::value <= sizeof(double),
+                  "Functor is over-aligned for lua userdata.");
+
     static int call(lua_State* L) {
-      int nargs = lua_gettop(L);
-      if (nargs != sizeof ...(TArgs)) {
-        pusher<const char*>::push(
+      if (lua_gettop(L) != sizeof ...(TArgs)) {
+        return luaL_error(
             L, "C++ function invoked with the wrong number of arguments.");
-        lua_error(L);
       }
-      void* ptr = lua_touserdata(L, lua_upvalueindex(1));
-      auto func = *(f_type*)ptr;
-      stack_popper p(-nargs);
+      T* func = static_cast<T*>(lua_touserdata(L, lua_upvalueindex(1)));
       try {
-        TRet ret = func(p.get<TArgs>(L) ...);
-        pusher<TRet>::push(L, ret);
+        return invoke(
+            L, *func, typename detail::build_indices<sizeof ...(TArgs)>::type());
       }
-      catch (std::exception e) {
-        pusher<const char*>::push(L, e.what());
-        lua_error(L);
+      catch (std::exception& e) {
+        lua_pushstring(L, e.what());
       }
-      return counter<TRet>::count();
+      return lua_error(L);
     }
 
-    static void push(lua_State* L, f_type* func) {
-      lua_pushlightuserdata(L, func);
-      lua_pushcclosure(L, &call, 1);
+    template <int ... Is>
+    static int invoke(lua_State* L, T& func, detail::indices<Is ...>) {
+      return returner<typename std::decay<TRet>::type>::call(
+          L,
+          func,
+          direct_popper<typename std::decay<TArgs>::type>::get(L, Is + 1) ...);
     }
 
     static int deleter(lua_State* L) {
-      void* ptr = lua_touserdata(L, -1);
-      auto func = *static_cast<f_type*>(ptr);
-      func.~f_type();
+      static_cast<T*>(lua_touserdata(L, 1))->~T();
       return 0;
     }
 
-    static void push(lua_State* L, const f_type& func) {
-      void* f_data = lua_newuserdata(L, sizeof(f_type));
-      f_type* f = new (f_data) f_type(func);
-      lua_newtable(L);
-      lua_pushcfunction(L, &deleter);
-      lua_setfield(L, -2, "__gc");
+    // One metatable per functor type, cached in the registry.
+    static void push_metatable(lua_State* L) {
+      static const char key = 0;
+      lua_pushlightuserdata(L, (void*)&key);
+      lua_rawget(L, LUA_REGISTRYINDEX);
+      if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        lua_createtable(L, 0, 1);
+        lua_pushcfunction(L, &deleter);
+        lua_setfield(L, -2, "__gc");
+        lua_pushlightuserdata(L, (void*)&key);
+        lua_pushvalue(L, -2);
+        lua_rawset(L, LUA_REGISTRYINDEX);
+      }
+    }
+
+    static void push(lua_State* L, const T& func) {
+      new (lua_newuserdata(L, sizeof(T))) T(func);
+      push_metatable(L);
       lua_setmetatable(L, -2);
 
       lua_pushcclosure(L, &call, 1);
     }
   };
 
+  template <typename T>
+  struct pusher<
+      T, typename std::enable_if<detail::functor_signature<T>::value>::type>
+      : functor_pusher<T> {
+  };
+
   template <typename TRet, typename ... TArgs>
   struct pusher<TRet(*)(TArgs ...), std::enable_if<true>::type> {
     typedef TRet(*f_type)(TArgs ...);
@@ -650,16 +762,20 @@ class val {
       }
       void* ptr = lua_touserdata(L, lua_upvalueindex(1));
       auto func = (f_type) ptr;
-      stack_popper p(-nargs);
       try {
-        TRet ret = func(p.get<TArgs>(L) ...);
-        pusher<TRet>::push(L, ret);
+        return invoke(
+            L, func, typename detail::build_indices<sizeof ...(TArgs)>::type());
       }
       catch (std::exception e) {
         pusher<const char*>::push(L, e.what());
-        lua_error(L);
       }
-      return counter<TRet>::count();
+      return lua_error(L);
+    }
+
+    template <int ... Is>
+    static int invoke(lua_State* L, f_type func, detail::indices<Is ...>) {
+      return returner<typename std::decay<TRet>::type>::call(
+          L, func, popper<typename std::decay<TArgs>::type>::get(L, Is + 1) ...);
     }
 
     static void push(lua_State* L, f_type func) {
@@ -668,6 +784,22 @@ class val {
     }
   };
 
+  template <typename F, F f>
+  struct pusher<fn<F, f>, std::enable_if<true>::type> {
+    static void push(lua_State* L, const fn<F, f>&) {
+      lua_pushcclosure(L, &fn<F, f>::call, 0);
+    }
+  };
+
+  template <typename F, F f>
+  struct pusher<ffi_fn<F, f>, std::enable_if<true>::type> {
+    static void push(lua_State* L, const ffi_fn<F, f>&) {
+      if (!ffi_fn<F, f>::push_cdata(L)) {
+        pusher<fn<F, f>>::push(L, fn<F, f>());
+      }
+    }
+  };
+
   template <typename TFrom, typename TTo>
   struct pusher<std::map<TFrom, TTo>, std::enable_if<true>::type> {
     static void push(lua_State* L, const std::map<TFrom, TTo>& map) {
@@ -775,6 +907,13 @@ class val {
 
   type type_;
   friend class var;
+  template <typename F, F f> friend struct fn;
+  template <typename F, F f> friend struct ffi_fn;
+  template <typename TSig> friend class function;
+  friend class coroutine;
+  friend class scheduler;
+  friend class detail::parallel;
+  friend class dataset;
   friend val chunk(const std::string& str);
 };
 
@@ -3,8 +3,10 @@
 #include <type_traits>
 #include <iostream>
 #include <vector>
+#include <iterator>
 
 #include "internal/traits.hpp"
+#include "internal/copy.hpp"
 
 namespace luapp11 {
 
@@ -55,19 +57,52 @@ class var {
   }
 
   /**
-   * Assigns the value at one place in thet lua environment to another.
+   * Assigns the value at one place in thet lua environment to another.  Between different lua states the value is
+   * deep copied, as by copy_from.
    * @var    The location to assign from.
    * @return The location assigned to.
    */
   var& operator=(const var & var) {
+    if (L != var.L) {
+      return copy_from(var);
+    }
     stack_guard g(L);
     push_parent_key();
-    if (L == var.L) {
+    {
       stack_guard g2(L, true);
       var.push();
+    }
+    lua_settable(L, lineage_.size() == 1 ? virtual_index_ : -3);
+    return *this;
+  }
+
+  /**
+   * Assigns a deep copy of the value at another place, which can be in another lua state.  Tables are copied with
+   * their metatables, and a table reached twice is copied once, so shared parts and cycles are kept.  Lua functions
+   * are copied as bytecode, with copies of their upvalues.  Throws for C functions, full userdata, and coroutines.
+   * @param from       The location to copy from.
+   * @param functions  Copy lua functions.  If false they throw like C functions.
+   * @return           The location assigned to.
+   */
+  var& copy_from(const var& from, bool functions = true) {
+    stack_guard g(L);
+    int top = lua_gettop(L), from_top = lua_gettop(from.L);
+    from.push();
+    detail::copier c(from.L, L, functions);
+    if (!c.copy(lua_gettop(from.L))) {
+      exception e(std::string("Unable to copy ") + c.failed + ".", from.L);
+      lua_settop(from.L, from_top);
+      throw e;
+    }
+    // Within one state the copy lands above the source.
+    if (from.L == L) {
+      lua_replace(L, top + 1);
+      lua_settop(L, top + 1);
     } else {
-      var.get_value().push(L);
+      lua_settop(from.L, from_top);
     }
+    push_parent_key();
+    lua_pushvalue(L, top + 1);
     lua_settable(L, lineage_.size() == 1 ? virtual_index_ : -3);
     return *this;
   }
@@ -80,9 +115,7 @@ class var {
   template <typename T> var& operator=(const T & toSet) {
     stack_guard g(L);
     push_parent_key();
-    val::pusher<
-        typename detail::convert_functor_to_std_function<T>::type>::push(L,
-                                                                         toSet);
+    val::pusher<T>::push(L, toSet);
     lua_settable(L, lineage_.size() == 1 ? virtual_index_ : -3);
     return *this;
   }
@@ -192,6 +225,31 @@ class var {
     throw exception("Tried to invoke non-function.", L);
   }
 
+  /**
+   * Call the function at this location once for each value in a range.  The function is only looked up once, and
+   * stays on the stack between calls.
+   * @param first  The start of the range of arguments.
+   * @param last   The end of the range of arguments.
+   * @param out    Where to write the result of each call.
+   * @return       The result of the invocations.  Stops at the first error.
+   */
+  template <typename TOut, typename TInputIt, typename TOutputIt>
+  result<void> invoke_each(TInputIt first, TInputIt last, TOutputIt out) {
+    return each<TOut>(first, last, [&out](result<TOut>& ret) { *out++ = ret.value(); });
+  }
+
+  /**
+   * Call the function at this location once for each value in a range, discarding what it returns.  For functions
+   * called for their effects, e.g. invoke_each<void>(first, last).
+   * @param first  The start of the range of arguments.
+   * @param last   The end of the range of arguments.
+   * @return       The result of the invocations.  Stops at the first error.
+   */
+  template <typename TOut, typename TInputIt>
+  result<void> invoke_each(TInputIt first, TInputIt last) {
+    return each<TOut>(first, last, [](result<TOut>&) {});
+  }
+
   /**
    * Execute a string as lua.  Assigns it's return value to this location in the lua environment.
    * @param  str The lua code to execute.
@@ -200,7 +258,7 @@ class var {
   error do_chunk(const std::string& str) {
     stack_guard g(L);
     push_parent_key();
-    auto err = luaL_loadstring(L, str.c_str());
+    auto err = detail::state_local<chunk_cache>(L).load(L, str);
     if (err != 0) {
       return error(err, "Unable to load chunk.", L);
     }
@@ -213,14 +271,15 @@ class var {
   }
 
   /**
-   * Execute a lua file.  Assigns it's return value to this location in the lua environment.
+   * Execute a lua file.  Assigns it's return value to this location in the lua environment.  Uses bytecode from
+   * the bytecode_store, or an up to date path + "c" file from compile_file, in place of the script when there is one.
    * @param  path The location of the file on disk.
    * @return      The error (if any) which occured while executing.
    */
   error do_file(const std::string& path) {
     stack_guard g(L);
     push_parent_key();
-    auto err = luaL_loadfile(L, path.c_str());
+    auto err = detail::state_local<bytecode_store>(L).load(L, path);
     if (err != 0) {
       return error(err, "Unable to load file.", L);
     }
@@ -251,6 +310,28 @@ class var {
     lua_gettable(L, lineage_.size() == 1 ? virtual_index_ : -2);
   }
 
+  // Calls the function once per value, handing each result to sink.
+  template <typename TOut, typename TInputIt, typename TSink>
+  result<void> each(TInputIt first, TInputIt last, TSink sink) {
+    typedef typename std::iterator_traits<TInputIt>::value_type TArg;
+    stack_guard g(L);
+    if (!dirty_is<TOut(TArg)>()) {
+      throw exception("Tried to invoke non-function.", L);
+    }
+    int func = lua_gettop(L);
+    for (; first != last; ++first) {
+      lua_pushvalue(L, func);
+      val::pusher<TArg>::push(L, *first);
+      auto ret = caller<TOut>::pcall(L, 1);
+      if (!ret) {
+        return ret.error();
+      }
+      sink(ret);
+      lua_settop(L, func);
+    }
+    return result<void>();
+  }
+
   // Is checking
   template <typename T> bool dirty_is() const {
     push();
@@ -362,7 +443,62 @@ class var {
   std::vector<val> lineage_;
   int virtual_index_;
 
-  friend class global;
+  friend class state;
+  template <typename TSig> friend class function;
+  friend class coroutine;
+  friend class budget;
+  friend class chunk_cache;
+  friend class bytecode_store;
+  friend class bundle;
+  friend class watcher;
+  friend class channel;
+  friend class broadcast;
+  friend class dataset;
 };
 
+inline chunk_cache& chunk_cache::of(const var& v) { return detail::state_local<chunk_cache>(v.L); }
+
+inline bytecode_store& bytecode_store::of(const var& v) { return detail::state_local<bytecode_store>(v.L); }
+
+inline void bundle::install(const var& v) const { install(v.L); }
+
+#ifdef __linux__
+inline watcher::watcher(const var& v) : watcher(v.L)
+{}
+#endif
+
+inline bool channel::try_send(const var& v) {
+  stack_guard g(v.L);
+  v.push();
+  bool sent;
+  const char* failed = push(*ring_, v.L, lua_gettop(v.L), sent);
+  if (failed != nullptr) {
+    throw exception(std::string("Unable to send ") + failed + ".", v.L);
+  }
+  return sent;
+}
+
+inline bool channel::try_recv(var v) {
+  stack_guard g(v.L);
+  v.push_parent_key();
+  if (!pop(*ring_, v.L)) {
+    return false;
+  }
+  lua_settable(v.L, v.lineage_.size() == 1 ? v.virtual_index_ : -3);
+  return true;
+}
+
+inline void channel::recv(var v) {
+  for (unsigned waits = 0; !try_recv(v); waits++) {
+    backoff(waits);
+  }
+}
+
+inline void channel::bind(const var& v) const {
+  stack_guard g(v.L);
+  v.push_parent_key();
+  bind(v.L);
+  lua_settable(v.L, v.lineage_.size() == 1 ? v.virtual_index_ : -3);
+}
+
 }
\ No newline at end of file
@@ -0,0 +1,250 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <chrono>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "luapp11/internal/mapped_file.hpp"
+
+namespace luapp11 {
+
+class var;
+class state;
+
+/**
+ * Reloads modules when their script files change on disk.  Linux only: uses inotify, and is left out elsewhere.
+ *
+ * Nothing happens until poll(), so reloads only happen at a safe point between calls into lua.  A changed module
+ * which has been required is compiled and run again, and the module it returns replaces the one in package.loaded.  If both the old and
+ * new module are tables the old table is updated in place, so code holding on to it sees the new functions.  Modules
+ * whose files didn't change keep their functions, and their JIT traces.
+ *
+ * <pre>
+ *   watcher w(global);
+ *   w.watch("rules", "scripts/rules.lua");
+ *   while (running) {
+ *     handle_requests();
+ *     for (auto& r : w.poll()) log(r.module, r.compile_time + r.run_time);
+ *   }
+ * </pre>
+ */
+class watcher {
+ public:
+  typedef std::chrono::steady_clock clock;
+
+  /**
+   * What happened to one module in a poll().
+   */
+  struct reload {
+    std::string module;
+    std::string path;
+    /** Why the module couldn't be reloaded, if it couldn't.  The old module stays in place. */
+    luapp11::error error;
+    clock::duration compile_time;
+    clock::duration run_time;
+  };
+
+  /**
+   * @param v  Any location in the lua state to reload modules in.
+   */
+  explicit watcher(const var& v);
+
+  /**
+   * @param s  The lua state to reload modules in.
+   */
+  explicit watcher(const state& s);
+
+  watcher(const watcher&) = delete;
+  watcher& operator=(const watcher&) = delete;
+
+  ~watcher() { close(fd_); }
+
+  /**
+   * Reload a module when its file changes.  Watches the file's directory, so editors which save by replacing the
+   * file are noticed too.  Only finished writes count: a file which is created is reloaded once it's closed after
+   * writing, not while it's still empty.
+   * @param module  The name the module is required by.
+   * @param path    The location of its script on disk.
+   */
+  void watch(const std::string& module, const std::string& path) {
+    auto slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+    std::string file = slash == std::string::npos ? path : path.substr(slash + 1);
+    int wd = inotify_add_watch(fd_, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd < 0) {
+      throw exception("Unable to watch " + dir);
+    }
+    modules_[std::make_pair(wd, file)].push_back(std::make_pair(module, path));
+  }
+
+  /**
+   * Reload the modules whose files changed since the last poll.  Doesn't wait for changes.
+   * @return  What happened to each reloaded module.
+   */
+  std::vector<reload> poll() {
+    std::set<std::pair<std::string, std::string>> changed;
+    alignas(inotify_event) char buffer[4096];
+    ssize_t size;
+    while ((size = read(fd_, buffer, sizeof(buffer))) > 0) {
+      for (char* p = buffer; p < buffer + size;) {
+        inotify_event* e = reinterpret_cast<inotify_event*>(p);
+        p += sizeof(inotify_event) + e->len;
+        if (e->len == 0) {
+          continue;
+        }
+        auto found = modules_.find(std::make_pair(e->wd, std::string(e->name)));
+        if (found != modules_.end()) {
+          changed.insert(found->second.begin(), found->second.end());
+        }
+      }
+    }
+    std::vector<reload> reloads;
+    for (auto& c : changed) {
+      if (required(c.first)) {
+        reloads.push_back(swap(c.first, c.second));
+      }
+    }
+    return reloads;
+  }
+
+  /**
+   * The inotify file descriptor.  Readable when a watched directory changed, for waiting in select or epoll.
+   */
+  int fd() const { return fd_; }
+
+  /**
+   * The number of modules reloaded, including failures.
+   */
+  size_t reloads() const { return reloads_; }
+
+  /**
+   * The number of reloads which failed.
+   */
+  size_t failures() const { return failures_; }
+
+ private:
+  explicit watcher(lua_State* L) : L { L }
+  , fd_ { inotify_init1(IN_NONBLOCK | IN_CLOEXEC) }
+  , reloads_ { 0 }
+  , failures_ { 0 }
+  {
+    if (fd_ < 0) {
+      throw exception("Unable to start inotify.", L);
+    }
+  }
+
+  // Pushes the table of loaded modules, which require keeps in the registry
+  // whether or not the package global is still there.  Pushes nothing and
+  // returns false if there isn't one.
+  bool push_loaded() {
+    lua_getfield(L, LUA_REGISTRYINDEX, "_LOADED");
+    if (!lua_istable(L, -1)) {
+      lua_pop(L, 1);
+      return false;
+    }
+    return true;
+  }
+
+  // Modules nobody has required yet will be loaded fresh when they are.
+  bool required(const std::string& module) {
+    if (!push_loaded()) {
+      return false;
+    }
+    lua_pushstring(L, module.c_str());
+    lua_rawget(L, -2);
+    bool found = !lua_isnil(L, -1);
+    lua_pop(L, 2);
+    return found;
+  }
+
+  reload swap(const std::string& module, const std::string& path) {
+    reload r { module, path, luapp11::error(), clock::duration::zero(), clock::duration::zero() };
+    reloads_++;
+    int top = lua_gettop(L);
+    auto start = clock::now();
+    int err = detail::load_whole(L, path);
+    r.compile_time = clock::now() - start;
+    if (err != 0) {
+      failures_++;
+      r.error = luapp11::error(err, "Unable to load file.", L);
+      lua_settop(L, top);
+      return r;
+    }
+    start = clock::now();
+    lua_pushstring(L, module.c_str());
+    err = lua_pcall(L, 1, 1, 0);
+    r.run_time = clock::now() - start;
+    if (err != 0) {
+      failures_++;
+      r.error = luapp11::error(err, "Unable to run file.", L);
+      lua_settop(L, top);
+      return r;
+    }
+    // Like require, a module which returns nothing is true.
+    if (lua_isnil(L, -1)) {
+      lua_pop(L, 1);
+      lua_pushboolean(L, 1);
+    }
+    int fresh = lua_gettop(L);
+    if (!push_loaded()) {
+      failures_++;
+      lua_pushstring(L, "package.loaded is missing");
+      r.error = luapp11::error(LUA_ERRRUN, "Unable to replace module.", L);
+      lua_settop(L, top);
+      return r;
+    }
+    int loaded = lua_gettop(L);
+    lua_pushstring(L, module.c_str());
+    lua_rawget(L, loaded);
+    if (lua_istable(L, -1) && lua_istable(L, fresh) && !lua_rawequal(L, -1, fresh)) {
+      patch(lua_gettop(L), fresh);
+    } else {
+      lua_pushstring(L, module.c_str());
+      lua_pushvalue(L, fresh);
+      lua_rawset(L, loaded);
+    }
+    lua_settop(L, top);
+    return r;
+  }
+
+  // Makes the old module table hold just what the new one does.
+  void patch(int old, int fresh) {
+    lua_pushnil(L);
+    while (lua_next(L, old) != 0) {
+      lua_pop(L, 1);
+      lua_pushvalue(L, -1);
+      lua_rawget(L, fresh);
+      if (lua_isnil(L, -1)) {
+        // Clearing a field during traversal is allowed.
+        lua_pushvalue(L, -2);
+        lua_pushnil(L);
+        lua_rawset(L, old);
+      }
+      lua_pop(L, 1);
+    }
+    lua_pushnil(L);
+    while (lua_next(L, fresh) != 0) {
+      lua_pushvalue(L, -2);
+      lua_insert(L, -2);
+      lua_rawset(L, old);
+    }
+  }
+
+  lua_State* L;
+  int fd_;
+  size_t reloads_;
+  size_t failures_;
+  std::map<std::pair<int, std::string>, std::vector<std::pair<std::string, std::string>>> modules_;
+};
+
+}
+
+#endif
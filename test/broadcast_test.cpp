@@ -0,0 +1,140 @@
+#include "catch.hpp"
+#include "luapp11/lua.hpp"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace luapp11;
+
+TEST_CASE("broadcast_test/apply", "broadcast apply test") {
+  state source;
+  CHECK(!source.do_chunk("config = { name = 'prod', limits = { 1, 2, 3 } } "
+                         "config.self = config"));
+  broadcast b(source["config"]);
+  CHECK(b.size() > 0);
+
+  state a, c;
+  b.apply(a["config"]);
+  b.apply(c["config"]);
+  CHECK(b.decodes() == 2);
+  CHECK(a["config"]["name"].get<std::string>() == "prod");
+  CHECK(!c["ok"].do_chunk("return config.self == config and "
+                          "#config.limits == 3"));
+  CHECK(c["ok"].get<bool>());
+
+  // Each state has its own copy.
+  CHECK(!a.do_chunk("config.name = 'test'"));
+  CHECK(c["config"]["name"].get<std::string>() == "prod");
+
+  source["n"] = 5;
+  broadcast n(source["n"]);
+  n.apply(a["n"], broadcast::decode::on_first_field);
+  CHECK(a["n"].get<int>() == 5);
+
+  CHECK(!source.do_chunk("f = { print }"));
+  CHECK_THROWS(broadcast { source["f"] });
+}
+
+TEST_CASE("broadcast_test/lazy", "broadcast lazy decode test") {
+  state source;
+  CHECK(!source.do_chunk("config = { name = 'prod', list = { 'a' } } "
+                         "config.self = config"));
+  broadcast b(source["config"]);
+
+  state a, c;
+  b.apply(a["config"], broadcast::decode::on_first_field);
+  b.apply(c["config"], broadcast::decode::on_first_field);
+  CHECK(b.decodes() == 0);
+
+  CHECK(a["config"]["name"].get<std::string>() == "prod");
+  CHECK(b.decodes() == 1);
+  CHECK(!a["ok"].do_chunk("return config.self == config and "
+                          "getmetatable(config) == nil and "
+                          "config.list[1] == 'a'"));
+  CHECK(a["ok"].get<bool>());
+  CHECK(b.decodes() == 1);
+
+  // A write decodes first, then lands.
+  CHECK(!c.do_chunk("config.extra = 1"));
+  CHECK(b.decodes() == 2);
+  CHECK(c["config"]["extra"].get<int>() == 1);
+  CHECK(c["config"]["name"].get<std::string>() == "prod");
+}
+
+TEST_CASE("broadcast_test/lazy_contents", "undecoded lazy table contents test") {
+  state source;
+  CHECK(!source.do_chunk("config = { name = 'prod', list = { 'a', 'b' } }"));
+  broadcast b(source["config"]);
+  auto lazy = broadcast::decode::on_first_field;
+
+  // Serializing from c++ or through a channel decodes it first.
+  state a;
+  b.apply(a["config"], lazy);
+  broadcast again(a["config"]);
+  CHECK(b.decodes() == 1);
+  state c;
+  again.apply(c["config"]);
+  CHECK(c["config"]["name"].get<std::string>() == "prod");
+
+  channel ch;
+  b.apply(a["config"], lazy);
+  ch.bind(a["ch"]);
+  CHECK(!a.do_chunk("ch:send(config)"));
+  ch.recv(c["received"]);
+  CHECK(c["received"]["list"][2].get<std::string>() == "b");
+
+  // So does copying it.
+  b.apply(a["config"], lazy);
+  c["copied"] = a["config"];
+  CHECK(c["copied"]["list"][1].get<std::string>() == "a");
+  CHECK(!c["ok"].do_chunk("return getmetatable(copied) == nil"));
+  CHECK(c["ok"].get<bool>());
+
+  // setmetatable fails rather than dropping the value.
+  b.apply(a["config"], lazy);
+  CHECK((bool)a.do_chunk("setmetatable(config, {})"));
+  CHECK(a["config"]["name"].get<std::string>() == "prod");
+}
+
+TEST_CASE("broadcast_test/pool", "broadcast to a pool test") {
+  state source;
+  CHECK(!source.do_chunk("config = { level = 3 }"));
+  broadcast b(source["config"]);
+  state_pool pool(3);
+  b.apply(pool, "config");
+  CHECK(b.decodes() == 3);
+  CHECK(pool.get_stats().in_use == 0);
+  for (int i = 0; i < 3; i++) {
+    auto s = pool.checkout();
+    CHECK(s["config"]["level"].get<int>() == 3);
+  }
+
+  // Holding a lease doesn't deadlock: that state is used as it is.
+  CHECK(!source.do_chunk("config.level = 4"));
+  broadcast b2(source["config"]);
+  {
+    auto held = pool.checkout();
+    b2.apply(pool, "config");
+    CHECK(held["config"]["level"].get<int>() == 4);
+    CHECK(pool.get_stats().in_use == 1);
+  }
+
+  // Nor do broadcasts from many threads at once.
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < 20; i++) {
+        b2.apply(pool, "config");
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  CHECK(pool.get_stats().in_use == 0);
+  for (int i = 0; i < 3; i++) {
+    auto s = pool.checkout();
+    CHECK(s["config"]["level"].get<int>() == 4);
+  }
+}
@@ -0,0 +1,99 @@
+#include <thread>
+
+#include "catch.hpp"
+#include "luapp11/lua.hpp"
+
+using namespace luapp11;
+
+TEST_CASE("budget_test/instructions", "budget instruction limit test") {
+  global["spin"].do_chunk(
+      R"PREFIX(
+    return function (n)
+      local i = 0
+      while n == 0 or i < n do
+        i = i + 1
+      end
+      return i
+    end
+    )PREFIX");
+
+  {
+    budget b(global, 100000);
+    auto r = global["spin"].invoke<int>(0);
+    CHECK(!r.success());
+    CHECK(r.error().error_type() == error::type::timeout);
+    CHECK(b.expired());
+    CHECK(b.used() >= 100000);
+  }
+  {
+    budget b(global, 1000000);
+    auto r = global["spin"].invoke<int>(100);
+    CHECK(r.success());
+    CHECK(r.value() == 100);
+    CHECK(!b.expired());
+  }
+  CHECK(global["spin"].invoke<int>(1000).value() == 1000);
+}
+
+TEST_CASE("budget_test/wall_time", "budget wall clock limit test") {
+  budget b(global, 0, std::chrono::milliseconds(20));
+  auto err = global["budget_spin"].do_chunk("while true do end");
+  CHECK(err.error_type() == error::type::timeout);
+  CHECK(b.elapsed() >= std::chrono::milliseconds(20));
+}
+
+TEST_CASE("budget_test/pcall", "budget pcall can't swallow timeout test") {
+  budget b(global, 50000);
+  auto err = global["budget_swallow"].do_chunk(
+      R"PREFIX(
+    while true do
+      pcall(function () while true do end end)
+    end
+    )PREFIX");
+  CHECK(err.error_type() == error::type::timeout);
+}
+
+TEST_CASE("budget_test/cancel", "budget watchdog cancel test") {
+  budget b(global, 0);
+  std::thread watchdog([&b]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    b.cancel();
+  });
+  auto err = global["budget_cancel"].do_chunk("while true do end");
+  watchdog.join();
+  CHECK(err.error_type() == error::type::cancelled);
+  CHECK(err.lua_message() == "Execution cancelled.");
+}
+
+TEST_CASE("budget_test/nested", "budget nesting test") {
+  budget outer(global, 0, std::chrono::seconds(10));
+  {
+    budget inner(global, 10000);
+    auto err = global["budget_nested"].do_chunk("while true do end");
+    CHECK(err.error_type() == error::type::timeout);
+  }
+  CHECK(!outer.expired());
+  CHECK(!global["budget_ok"].do_chunk("return 1"));
+}
+
+TEST_CASE("budget_test/nested_jit", "nested budgets keep the JIT off test") {
+  auto jit_on = []() {
+    global["budget_jit"].do_chunk("return (jit.status())");
+    return global["budget_jit"] == true;
+  };
+  REQUIRE(jit_on());
+  {
+    budget outer(global, 0, std::chrono::seconds(10));
+    CHECK(!jit_on());
+    { budget inner(global, 1000000); }
+    CHECK(!jit_on());
+  }
+  CHECK(jit_on());
+
+  // A JIT the user turned off stays off.
+  global["budget_jit"].do_chunk("jit.off()");
+  { budget b(global, 1000000); }
+  CHECK(!jit_on());
+  global["budget_jit"].do_chunk("jit.on()");
+  CHECK(jit_on());
+}
@@ -0,0 +1,71 @@
+#include "catch.hpp"
+#include "luapp11/lua.hpp"
+
+#include <cstdio>
+#include <fstream>
+
+using namespace luapp11;
+
+namespace {
+void write(const std::string& path, const std::string& contents) {
+  std::ofstream(path, std::ios::binary) << contents;
+}
+}
+
+TEST_CASE("bundle_test/require", "bundle require test") {
+  write("bundle_test_a.lua", "return { name = ..., answer = 42 }");
+  write("bundle_test_b.lua", "bundle_b_ran = true return {}");
+  CHECK(!bundle::write("bundle_test.bundle",
+                       { { "pkg.b", "bundle_test_b.lua" },
+                         { "pkg.a", "bundle_test_a.lua" } }));
+  std::remove("bundle_test_a.lua");
+  std::remove("bundle_test_b.lua");
+
+  {
+    bundle b("bundle_test.bundle");
+    CHECK(b.size() == 2);
+    CHECK(b.contains("pkg.a"));
+    CHECK(!b.contains("pkg"));
+    b.install(global);
+    CHECK(!global["a"].do_chunk("return require('pkg.a')"));
+    CHECK(global["a"]["name"].get<std::string>() == "pkg.a");
+    CHECK(global["a"]["answer"].get<int>() == 42);
+    CHECK(!global["a"].do_chunk("return require('pkg.a')"));
+    CHECK(b.loads() == 1);
+    CHECK(!global["bundle_b_ran"].is<bool>());
+  }
+
+  // The state keeps the bundle mapped after the bundle object is gone.
+  CHECK(!global["b"].do_chunk("require('pkg.b') return bundle_b_ran"));
+  CHECK(global["b"].get<bool>());
+
+  auto err = global["c"].do_chunk("return require('pkg.missing')");
+  CHECK(err.error_type() == error::type::runtime);
+  CHECK(err.lua_message().find("no module 'pkg.missing' in bundle") !=
+        std::string::npos);
+  std::remove("bundle_test.bundle");
+}
+
+TEST_CASE("bundle_test/source", "bundle of source test") {
+  write("bundle_test_c.lua", "return 'c'\n");
+  CHECK(!bundle::write("bundle_test_src.bundle",
+                       { { "src.c", "bundle_test_c.lua" } }, false));
+  std::remove("bundle_test_c.lua");
+  bundle("bundle_test_src.bundle").install(global["package"]);
+  CHECK(!global["c"].do_chunk("return require('src.c')"));
+  CHECK(global["c"].get<std::string>() == "c");
+  std::remove("bundle_test_src.bundle");
+}
+
+TEST_CASE("bundle_test/errors", "bundle error test") {
+  CHECK(bundle::write("bundle_test_bad.bundle",
+                      { { "bad", "../test/lua/fail.lua" } })
+            .error_type() == error::type::syntax);
+  CHECK(bundle::write("bundle_test_bad.bundle", { { "bad", "missing.lua" } },
+                      false).error_type() == error::type::file);
+
+  write("bundle_test_bad.bundle", "LUAPP11B but too short");
+  CHECK_THROWS_AS(bundle{ "bundle_test_bad.bundle" }, exception);
+  std::remove("bundle_test_bad.bundle");
+  CHECK_THROWS_AS(bundle{ "bundle_test_bad.bundle" }, exception);
+}
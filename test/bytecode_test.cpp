@@ -0,0 +1,109 @@
+#include "catch.hpp"
+#include "luapp11/lua.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+#include <utime.h>
+
+using namespace luapp11;
+
+namespace {
+void write(const std::string& path, const std::string& contents) {
+  std::ofstream(path) << contents;
+}
+}
+
+TEST_CASE("bytecode_test/dump", "dump_file test") {
+  std::string full, stripped;
+  CHECK(!dump_file("../test/lua/test.lua", full));
+  CHECK(!dump_file("../test/lua/test.lua", stripped, true));
+  CHECK(full.size() > 0);
+  CHECK(full[0] == '\x1b');
+  CHECK(stripped.size() < full.size());
+
+  auto err = dump_file("../test/lua/missing.lua", full);
+  CHECK(err.error_type() == error::type::file);
+  err = dump_file("../test/lua/fail.lua", full);
+  CHECK(err.error_type() == error::type::syntax);
+}
+
+TEST_CASE("bytecode_test/store", "bytecode store test") {
+  std::string bytecode;
+  CHECK(!dump_file("../test/lua/test.lua", bytecode));
+
+  auto& store = bytecode_store::of(global);
+  CHECK(&store == &bytecode_store::of(global["x"]));
+  store.add("not/on/disk.lua", bytecode);
+  CHECK(store.contains("not/on/disk.lua"));
+  CHECK(!global["fact"].do_file("not/on/disk.lua"));
+  CHECK(global["fact"].get<int>() == 120);
+  CHECK(store.loads() == 1);
+
+  store.remove("not/on/disk.lua");
+  CHECK(store.size() == 0);
+  CHECK(global["fact"].do_file("not/on/disk.lua").error_type() ==
+        error::type::file);
+}
+
+TEST_CASE("bytecode_test/sidecar", "compile_file sidecar test") {
+  write("bytecode_test.lua", "return 1");
+  CHECK(!compile_file("bytecode_test.lua", "bytecode_test.luac", true));
+  // A sidecar newer than the script is preferred.
+  write("bytecode_test.lua", "return 2");
+  struct utimbuf old = { 1000000000, 1000000000 };
+  REQUIRE(utime("bytecode_test.lua", &old) == 0);
+  CHECK(!global["r"].do_file("bytecode_test.lua"));
+  CHECK(global["r"].get<int>() == 1);
+
+  // The script changes, even within the same second, so it wins.
+  write("bytecode_test.lua", "return 3");
+  CHECK(!global["r"].do_file("bytecode_test.lua"));
+  CHECK(global["r"].get<int>() == 3);
+
+  std::remove("bytecode_test.luac");
+  CHECK(!global["r"].do_file("bytecode_test.lua"));
+  CHECK(global["r"].get<int>() == 3);
+  std::remove("bytecode_test.lua");
+
+  CHECK(compile_file("../test/lua/test.lua", "no/such/dir/test.luac")
+            .error_type() == error::type::file);
+}
+
+TEST_CASE("bytecode_test/compile", "parallel compile test") {
+  std::vector<std::string> paths;
+  for (int i = 0; i < 20; i++) {
+    paths.push_back("bytecode_test_" + std::to_string(i) + ".lua");
+    write(paths.back(), "return " + std::to_string(i) + " * 2");
+  }
+  paths.push_back("../test/lua/fail.lua");
+
+  auto& store = bytecode_store::of(global);
+  auto err = store.compile(paths, true, 4);
+  CHECK(err.error_type() == error::type::syntax);
+  CHECK(!store.contains("../test/lua/fail.lua"));
+  for (int i = 0; i < 20; i++) {
+    std::remove(paths[i].c_str());
+    CHECK(store.contains(paths[i]));
+    CHECK(!global["r"].do_file(paths[i]));
+    CHECK(global["r"].get<int>() == i * 2);
+    store.remove(paths[i]);
+  }
+}
+
+TEST_CASE("bytecode_test/preload", "parallel preload test") {
+  write("bytecode_test_a.lua", "loaded_a = true return { name = ... }");
+  write("bytecode_test_b.lua", "loaded_b = true return { name = ... }");
+  auto& store = bytecode_store::of(global);
+  CHECK(!store.preload({ { "mod.a", "bytecode_test_a.lua" },
+                         { "mod.b", "bytecode_test_b.lua" } }, false, 2));
+  std::remove("bytecode_test_a.lua");
+  std::remove("bytecode_test_b.lua");
+
+  CHECK(!global["loaded_a"].is<bool>());
+  CHECK(!global["m"].do_chunk("return require('mod.a').name"));
+  CHECK(global["m"].get<std::string>() == "mod.a");
+  CHECK(global["loaded_a"].is<bool>());
+  CHECK(!global["loaded_b"].is<bool>());
+}
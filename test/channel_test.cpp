@@ -0,0 +1,87 @@
+#include "catch.hpp"
+#include "luapp11/lua.hpp"
+
+#include <string>
+#include <thread>
+
+using namespace luapp11;
+
+TEST_CASE("channel_test/values", "channel round trip test") {
+  state a, b;
+  channel ch(4);
+  CHECK(ch.capacity() == 4);
+  ch.bind(a["ch"]);
+  ch.bind(b["ch"]);
+
+  CHECK(!a.do_chunk("local shared = { 1, 2 } "
+                    "t = { n = -3, x = 0.25, big = 2^60, z = -0.0, s = 'a\\0b', "
+                    "      l = shared, r = shared, [10] = true, nested = {} } "
+                    "t.self = t "
+                    "ch:send(t) ch:send('two') ch:send(nil)"));
+  CHECK(ch.size() == 3);
+  CHECK(!b.do_chunk("t = ch:recv() two = ch:recv() "
+                    "ok, none = ch:try_recv() "
+                    "empty = ch:try_recv()"));
+  CHECK(ch.size() == 0);
+  CHECK(b["t"]["n"].get<int>() == -3);
+  CHECK(b["t"]["x"].get<double>() == 0.25);
+  CHECK(b["two"].get<std::string>() == "two");
+  CHECK(b["ok"].get<bool>());
+  CHECK(!b["empty"].get<bool>());
+  CHECK(!b["same"].do_chunk("return t.l == t.r and t.self == t and "
+                            "t.big == 2^60 and t.s == 'a\\0b' and "
+                            "t[10] == true and #t.l == 2 and 1 / t.z < 0 and "
+                            "next(t.nested) == nil"));
+  CHECK(b["same"].get<bool>());
+}
+
+TEST_CASE("channel_test/full", "channel full and errors test") {
+  state s;
+  channel ch(2);
+  ch.bind(s["ch"]);
+  CHECK(!s["sent"].do_chunk("return ch:try_send(1) and ch:try_send(2) and "
+                            "not ch:try_send(3)"));
+  CHECK(s["sent"].get<bool>());
+
+  s["x"] = 5;
+  CHECK(!ch.try_send(s["x"]));
+  CHECK(ch.try_recv(s["y"]));
+  CHECK(s["y"].get<int>() == 1);
+  CHECK(ch.try_send(s["x"]));
+
+  CHECK((bool)s.do_chunk("ch:try_send(print)"));
+  s["f"] = [](int i) { return i; };
+  CHECK_THROWS(ch.try_send(s["f"]));
+}
+
+TEST_CASE("channel_test/yield", "channel recv yields in a coroutine test") {
+  state s;
+  channel ch;
+  ch.bind(s["ch"]);
+  CHECK(!s.do_chunk("co = coroutine.create(function() got = ch:recv() end) "
+                    "coroutine.resume(co)"));
+  CHECK(!s["status"].do_chunk("return coroutine.status(co)"));
+  CHECK(s["status"].get<std::string>() == "suspended");
+  s["msg"] = std::string("hello");
+  ch.send(s["msg"]);
+  CHECK(!s.do_chunk("coroutine.resume(co)"));
+  CHECK(s["got"].get<std::string>() == "hello");
+}
+
+TEST_CASE("channel_test/threads", "channel between threads test") {
+  channel ch(8);
+  const int count = 2000;
+  std::thread producer([&ch, count]() {
+    state p;
+    ch.bind(p["ch"]);
+    p["count"] = count;
+    p.do_chunk("for i = 1, count do ch:send({ i = i }) end");
+  });
+  state c;
+  ch.bind(c["ch"]);
+  c["count"] = count;
+  CHECK(!c["total"].do_chunk("local t = 0 for i = 1, count do "
+                             "t = t + ch:recv().i end return t"));
+  producer.join();
+  CHECK(c["total"].get<int>() == count * (count + 1) / 2);
+}
@@ -0,0 +1,65 @@
+#include "catch.hpp"
+#include "luapp11/lua.hpp"
+
+using namespace luapp11;
+
+TEST_CASE("chunk_cache_test/hits", "chunk cache hit test") {
+  auto& cache = chunk_cache::of(global);
+  CHECK(&cache == &chunk_cache::of(global["x"]));
+  cache.clear();
+  size_t hits = cache.hits();
+  size_t misses = cache.misses();
+
+  CHECK(!global["r"].do_chunk("counter = (counter or 0) + 1"));
+  CHECK(!global["r"].do_chunk("counter = (counter or 0) + 1"));
+  CHECK(!global["r"].do_chunk("counter = (counter or 0) + 1"));
+  CHECK(global["counter"].get<int>() == 3);
+  CHECK(cache.misses() == misses + 1);
+  CHECK(cache.hits() == hits + 2);
+  CHECK(cache.size() == 1);
+
+  global["answer"].do_chunk("return 6 * 7");
+  global["again"].do_chunk("return 6 * 7");
+  CHECK(global["again"].get<int>() == 42);
+  CHECK(cache.hits() == hits + 3);
+  CHECK(cache.size() == 2);
+}
+
+TEST_CASE("chunk_cache_test/errors", "chunk cache error test") {
+  auto& cache = chunk_cache::of(global);
+  cache.clear();
+  auto err = global["r"].do_chunk("this isn't lua");
+  CHECK(err.error_type() == error::type::syntax);
+  CHECK(cache.size() == 0);
+
+  CHECK(global["r"].do_chunk("error('boom')").error_type() == error::type::runtime);
+  CHECK(global["r"].do_chunk("error('boom')").error_type() == error::type::runtime);
+  CHECK(cache.size() == 1);
+}
+
+TEST_CASE("chunk_cache_test/eviction", "chunk cache eviction test") {
+  auto& cache = chunk_cache::of(global);
+  cache.clear();
+  cache.set_capacity(30);
+  size_t evictions = cache.evictions();
+
+  CHECK(!global["r"].do_chunk("local a = 1"));  // 11 bytes
+  CHECK(!global["r"].do_chunk("local b = 2"));
+  CHECK(!global["r"].do_chunk("local a = 1"));  // a is now the most recent
+  CHECK(cache.memory() == 22);
+  CHECK(!global["r"].do_chunk("local c = 3"));
+  CHECK(cache.evictions() == evictions + 1);
+  CHECK(cache.size() == 2);
+
+  size_t misses = cache.misses();
+  CHECK(!global["r"].do_chunk("local a = 1"));
+  CHECK(cache.misses() == misses);
+  CHECK(!global["r"].do_chunk("local b = 2"));
+  CHECK(cache.misses() == misses + 1);
+
+  cache.set_capacity(0);
+  CHECK(cache.size() == 0);
+  CHECK(!global["r"].do_chunk("local a = 1"));
+  CHECK(cache.size() == 0);
+  cache.set_capacity(1 << 20);
+}
@@ -0,0 +1,74 @@
+#include "catch.hpp"
+#include "luapp11/lua.hpp"
+
+#include <memory>
+#include <string>
+
+using namespace luapp11;
+
+namespace {
+// Counts its copies and moves, so a test can see whether calling a bound
+// functor copies it, without replacing the allocator for the whole binary.
+struct copy_counter {
+  explicit copy_counter(int& copies) : copies { &copies }
+  {}
+  copy_counter(const copy_counter& o) : copies { o.copies } { ++*copies; }
+  copy_counter(copy_counter&& o) : copies { o.copies } { ++*copies; }
+
+  int* copies;
+};
+}
+
+TEST_CASE("closure_test/call", "lambda and functor call test") {
+  int offset = 3;
+  global["adder"] = [offset](int a, int b) { return a + b + offset; };
+  CHECK(!(bool) global["r"].do_chunk("return adder(1, 2)"));
+  CHECK(global["r"] == 6);
+
+  int calls = 0;
+  global["counter"] = [&calls]() mutable { return ++calls; };
+  global["r"].do_chunk("counter() return counter()");
+  CHECK(calls == 2);
+  CHECK(global["r"] == 2);
+
+  std::function<std::string(std::string)> shout = [](std::string s) {
+    return s + "!";
+  };
+  global["shout"] = shout;
+  global["r"].do_chunk("return shout('hey')");
+  CHECK(global["r"] == std::string("hey!"));
+}
+
+TEST_CASE("closure_test/copies", "no copies per call test") {
+  int calls = 0;
+  int copies = 0;
+  copy_counter counter(copies);
+  global["counted"] = [&calls, counter](int a) {
+    ++calls;
+    return a + 1;
+  };
+  auto loop = global["loop"];
+  loop.do_chunk(
+      R"PREFIX(
+    return function (n)
+      local s = 0
+      for i = 1, n do s = counted(i) end
+      return s
+    end
+    )PREFIX");
+
+  auto before = copies;
+  CHECK(loop.invoke<int>(1000).value() == 1001);
+  CHECK(calls == 1000);
+  CHECK(copies == before);
+}
+
+TEST_CASE("closure_test/gc", "closure destroyed by gc test") {
+  auto captured = std::make_shared<int>(5);
+  global["holder"] = [captured]() { return *captured; };
+  CHECK(captured.use_count() == 2);
+
+  global["holder"] = val::nil();
+  do_chunk("collectgarbage()");
+  CHECK(captured.use_count() == 1);
+}
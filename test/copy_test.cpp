@@ -0,0 +1,81 @@
+#include "catch.hpp"
+#include "luapp11/lua.hpp"
+
+#include <string>
+
+using namespace luapp11;
+
+TEST_CASE("copy_test/tables", "copy tables between states test") {
+  state a, b;
+  CHECK(!a.do_chunk("local shared = { 1, 2, 3 } "
+                    "t = { n = 5, name = 'x\\0y', list = { 'a', 'b' }, "
+                    "      left = shared, right = shared, [true] = 1.5 } "
+                    "t.self = t"));
+  b["t"] = a["t"];
+  CHECK(b["t"]["n"].get<int>() == 5);
+  CHECK(b["t"]["list"][2].get<std::string>() == "b");
+  CHECK(!b["ok"].do_chunk("return t.left == t.right and t.self == t and "
+                          "#t.left == 3 and t[true] == 1.5 and "
+                          "t.name == 'x\\0y'"));
+  CHECK(b["ok"].get<bool>());
+
+  // A copy, not a reference.
+  CHECK(!b.do_chunk("t.n = 6"));
+  CHECK(a["t"]["n"].get<int>() == 5);
+
+  // Into a field, and within one state.
+  b["u"] = { 1 };
+  b["u"]["inner"] = a["t"]["list"];
+  CHECK(b["u"]["inner"][1].get<std::string>() == "a");
+  a["clone"].copy_from(a["t"]);
+  CHECK(!a["ok"].do_chunk("return clone ~= t and clone.self == clone and "
+                          "clone.left == clone.right and clone.left ~= t.left"));
+  CHECK(a["ok"].get<bool>());
+}
+
+TEST_CASE("copy_test/metatables", "copy metatables test") {
+  state a, b;
+  CHECK(!a.do_chunk("v = setmetatable({}, { __index = { kind = 'vec' } })"));
+  b["v"] = a["v"];
+  CHECK(b["v"]["kind"].get<std::string>() == "vec");
+}
+
+TEST_CASE("copy_test/functions", "copy functions test") {
+  state a, b;
+  CHECK(!a.do_chunk("local base = 10 "
+                    "function add(x) return base + x end "
+                    "local function fact(n) if n < 2 then return 1 end "
+                    "return n * fact(n - 1) end "
+                    "t = { fact = fact, again = fact }"));
+  b["add"] = a["add"];
+  CHECK(b["add"].invoke<int>(5).value() == 15);
+  b["t"] = a["t"];
+  CHECK(b["t"]["fact"].invoke<int>(5).value() == 120);
+  CHECK(!b["ok"].do_chunk("return t.fact == t.again"));
+  CHECK(b["ok"].get<bool>());
+
+  CHECK_THROWS(b["f"].copy_from(a["add"], false));
+  CHECK_THROWS(b["p"] = a["print"]);
+  CHECK(!b["f"].is<int>());
+}
+
+TEST_CASE("copy_test/failure", "copy failure leaves the stacks test") {
+  state a, b;
+  CHECK(!a.do_chunk("t = { 1, 2, co = coroutine.create(function() end) }"));
+  int top_a = lua_gettop(a.lua()), top_b = lua_gettop(b.lua());
+  CHECK_THROWS(b["t"] = a["t"]);
+  CHECK(lua_gettop(a.lua()) == top_a);
+  CHECK(lua_gettop(b.lua()) == top_b);
+  CHECK(!b["t"].is<int>());
+}
+
+TEST_CASE("copy_test/upvalues", "copy shared upvalues test") {
+  state a, b;
+  CHECK(!a.do_chunk("local n = 0 "
+                    "counter = { inc = function() n = n + 1 return n end, "
+                    "            get = function() return n end }"));
+  b["counter"] = a["counter"];
+  CHECK(!b.do_chunk("counter.inc() counter.inc()"));
+  CHECK(b["counter"]["get"].invoke<int>().value() == 2);
+  CHECK(a["counter"]["get"].invoke<int>().value() == 0);
+}
@@ -0,0 +1,185 @@
+#include "catch.hpp"
+#include "luapp11/lua.hpp"
+
+using namespace luapp11;
+
+TEST_CASE("coroutine_test/resume", "coroutine resume test") {
+  global["gen"].do_chunk(
+      R"PREFIX(
+    return function (n)
+      local i = 1
+      while i <= n do
+        local got = coroutine.yield(i, "yielded")
+        n = n + (got or 0)
+        i = i + 1
+      end
+      return 0, "done"
+    end
+    )PREFIX");
+
+  coroutine co(global["gen"]);
+  CHECK(co.get_status() == coroutine::status::suspended);
+  auto first = co.resume<std::tuple<int, std::string>>(2);
+  CHECK(first.success());
+  CHECK(first.value() == std::make_tuple(1, "yielded"));
+  CHECK(co.resume<int>().value() == 2);
+  CHECK(co.resume<int>(1).value() == 3);
+  CHECK(!co.done());
+
+  auto last = co.resume<std::tuple<int, std::string>>();
+  CHECK(last.value() == std::make_tuple(0, "done"));
+  CHECK(co.done());
+  CHECK(co.get_status() == coroutine::status::finished);
+  CHECK_THROWS(co.resume<void>());
+}
+
+TEST_CASE("coroutine_test/errors", "coroutine error test") {
+  CHECK_THROWS(coroutine { global["dne"] });
+
+  global["bad"].do_chunk(
+      "return function () coroutine.yield() error('broken') end");
+  coroutine co(global["bad"]);
+  CHECK(co.resume<void>().success());
+  auto ret = co.resume<void>();
+  CHECK(!ret.success());
+  CHECK(ret.error().lua_message().find("broken") != std::string::npos);
+  CHECK(co.get_status() == coroutine::status::error);
+}
+
+TEST_CASE("coroutine_test/thread_val", "thread val push test") {
+  do_chunk("co = coroutine.create(function () end)");
+  global["co2"] = global["co"].get_value();
+  global["r"].do_chunk("return co == co2");
+  CHECK(global["r"] == true);
+}
+
+TEST_CASE("coroutine_test/pool", "coroutine thread pool test") {
+  global["task"].do_chunk(
+      "return function (n) coroutine.yield(n) return n * 2 end");
+  auto& pool = coroutine::pool(global["task"]);
+  pool.set_capacity(2);
+  auto created = pool.created();
+  auto reused = pool.reused();
+
+  for (int i = 0; i < 10; i++) {
+    coroutine co(global["task"]);
+    CHECK(co.resume<int>(i).value() == i);
+    CHECK(co.resume<int>().value() == i * 2);
+  }
+  CHECK(pool.created() <= created + 1);
+  CHECK(pool.reused() >= reused + 9);
+  CHECK(pool.size() == 1);
+
+  {
+    coroutine a(global["task"]), b(global["task"]), c(global["task"]);
+    a.resume<int>(1);
+    a.resume<int>();
+    b.resume<int>(1);
+    b.resume<int>();
+    c.resume<int>(1);
+    c.resume<int>();
+  }
+  CHECK(pool.size() == 2);
+
+  // Unfinished coroutines are not reused.
+  {
+    coroutine co(global["task"]);
+    co.resume<int>(1);
+  }
+  CHECK(pool.size() == 1);
+}
+
+TEST_CASE("coroutine_test/closed_state", "coroutine outliving its state test") {
+  std::unique_ptr<coroutine> finished, suspended;
+  {
+    state s;
+    s.do_chunk("function task(n) coroutine.yield(n) return n end");
+    finished.reset(new coroutine(s["task"]));
+    suspended.reset(new coroutine(s["task"]));
+    finished->resume<int>(1);
+    finished->resume<int>();
+    suspended->resume<int>(1);
+  }
+  CHECK_THROWS(suspended->resume<int>());
+  finished.reset();
+  suspended.reset();
+}
+
+TEST_CASE("coroutine_test/slice", "time sliced coroutine test") {
+  global["spin"].do_chunk(
+      R"PREFIX(
+    return function (n)
+      local s = 0
+      for i = 1, n do s = s + i end
+      return s
+    end
+    )PREFIX");
+
+  coroutine co(global["spin"]);
+  int slices = 0;
+  auto ret = co.resume_for<double>(1000, 100000);
+  while (co.preempted()) {
+    CHECK(!co.done());
+    slices++;
+    ret = co.resume_for<double>(1000);
+  }
+  CHECK(slices > 10);
+  CHECK(co.get_status() == coroutine::status::finished);
+  CHECK(ret.value() == 5000050000.0);
+
+  // Without a slice it runs to completion.
+  coroutine co2(global["spin"]);
+  CHECK(co2.resume<double>(100000).value() == 5000050000.0);
+  CHECK(!co2.preempted());
+
+  // Slicing only a later resume still keeps the loop out of compiled code.
+  global["late"].do_chunk(
+      "return function () for i = 1, 1000 do end coroutine.yield() while true do end end");
+  coroutine co3(global["late"]);
+  co3.resume<void>();
+  co3.resume_for<void>(10000);
+  CHECK(co3.preempted());
+}
+
+TEST_CASE("coroutine_test/slice_from_c", "time slice running out inside lua called from C test") {
+  global["sorter"].do_chunk(
+      R"PREFIX(
+    return function (n)
+      local t = {}
+      for i = 1, n do t[i] = (i * 7919) % n end
+      table.sort(t, function (a, b)
+        local x = 0
+        for j = 1, 10 do x = x + j end
+        return a < b
+      end)
+      for i = 2, n do assert(t[i - 1] <= t[i]) end
+      return t[n]
+    end
+    )PREFIX");
+
+  coroutine co(global["sorter"]);
+  int slices = 0;
+  auto ret = co.resume_for<int>(500, 2000);
+  while (co.preempted()) {
+    slices++;
+    ret = co.resume_for<int>(500);
+  }
+  CHECK(ret.success());
+  CHECK(co.get_status() == coroutine::status::finished);
+  CHECK(ret.value() == 1999);
+  CHECK(slices > 2);
+}
+
+TEST_CASE("coroutine_test/slice_hooks", "time slice keeps an outer budget test") {
+  global["forever"].do_chunk("return function () while true do end end");
+
+  budget b(global["forever"], 100000);
+  coroutine co(global["forever"]);
+  auto ret = co.resume_for<void>(1000);
+  while (co.preempted()) {
+    ret = co.resume_for<void>(1000);
+  }
+  CHECK(!ret.success());
+  CHECK(ret.error().error_type() == error::type::timeout);
+  CHECK(b.expired());
+}
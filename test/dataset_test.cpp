@@ -0,0 +1,96 @@
+#include "catch.hpp"
+#include "luapp11/lua.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace luapp11;
+
+TEST_CASE("dataset_test/map", "dataset over a hash map test") {
+  auto prices = std::make_shared<const std::unordered_map<std::string, double>>(
+      std::unordered_map<std::string, double> { { "a", 1.5 }, { "b", 2 } });
+  dataset d = dataset::of(prices);
+  CHECK(d.size() == 2);
+
+  state s;
+  d.bind(s["prices"]);
+  CHECK(s["prices"]["a"].get<double>() == 1.5);
+  CHECK(!s["ok"].do_chunk("return prices.b == 2 and prices.c == nil and "
+                          "prices[1] == nil and #prices == 2"));
+  CHECK(s["ok"].get<bool>());
+  CHECK(!s["total"].do_chunk("local t = 0 for k, v in prices() do "
+                             "t = t + v end return t"));
+  CHECK(s["total"].get<double>() == 3.5);
+  CHECK((bool)s.do_chunk("prices.a = 5"));
+}
+
+TEST_CASE("dataset_test/number_keys", "dataset number key range test") {
+  auto signed_map = std::make_shared<const std::unordered_map<int64_t, int>>(
+      std::unordered_map<int64_t, int> { { 1, 10 }, { INT64_MIN, 20 } });
+  auto unsigned_map = std::make_shared<const std::unordered_map<uint64_t, int>>(
+      std::unordered_map<uint64_t, int> { { 1, 10 } });
+  auto small_map = std::make_shared<const std::unordered_map<unsigned char, int>>(
+      std::unordered_map<unsigned char, int> { { 255, 10 }, { 0, 20 } });
+
+  state s;
+  dataset::of(signed_map).bind(s["signed"]);
+  dataset::of(unsigned_map).bind(s["unsigned"]);
+  dataset::of(small_map).bind(s["small"]);
+  CHECK(!s["ok"].do_chunk("local nan = 0 / 0 "
+                          "return signed[1] == 10 and signed[-2 ^ 63] == 20 and "
+                          "signed[2 ^ 63] == nil and signed[nan] == nil and "
+                          "unsigned[1] == 10 and unsigned[2 ^ 64] == nil and "
+                          "unsigned[nan] == nil and unsigned[-1] == nil and "
+                          "small[255] == 10 and small[0] == 20 and "
+                          "small[256] == nil and small[1.5] == nil"));
+  CHECK(s["ok"].get<bool>());
+}
+
+TEST_CASE("dataset_test/vector", "dataset over a vector test") {
+  auto values = std::make_shared<const std::vector<int>>(
+      std::vector<int> { 10, 20, 30 });
+  dataset d = dataset::of(values);
+  state s;
+  d.bind(s["v"]);
+  CHECK(!s["ok"].do_chunk("return v[1] == 10 and v[3] == 30 and "
+                          "v[0] == nil and v[4] == nil and v[1.5] == nil and "
+                          "v.x == nil and #v == 3"));
+  CHECK(s["ok"].get<bool>());
+  CHECK(!s["keys"].do_chunk("local k = 0 for i, x in v() do "
+                            "k = k + i * x end return k"));
+  CHECK(s["keys"].get<int>() == 140);
+}
+
+TEST_CASE("dataset_test/shared", "dataset shared between states test") {
+  auto values = std::make_shared<const std::vector<double>>(
+      std::vector<double>(100000, 1.0));
+  dataset d = dataset::of(values);
+  std::vector<state> states(4);
+  for (auto& s : states) {
+    d.bind(s["data"]);
+  }
+
+  std::vector<double> sums(states.size());
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < states.size(); i++) {
+    threads.emplace_back([&states, &sums, i]() {
+      states[i]["sum"].do_chunk("local t = 0 for i = 1, #data do "
+                                "t = t + data[i] end return t");
+      sums[i] = states[i]["sum"].get<double>();
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  for (auto s : sums) {
+    CHECK(s == 100000);
+  }
+
+  // Each state holds a userdata, not the data.
+  CHECK(!states[0]["kb"].do_chunk("return collectgarbage('count')"));
+  CHECK(states[0]["kb"].get<double>() < 200);
+}
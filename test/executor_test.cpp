@@ -0,0 +1,77 @@
+#include "catch.hpp"
+#include "luapp11/lua.hpp"
+
+#include <atomic>
+#include <future>
+#include <vector>
+
+using namespace luapp11;
+
+namespace {
+void init(state& s) {
+  s.do_chunk(
+      R"PREFIX(
+    function square(x) return x * x end
+    function label(name, n) return name .. n end
+    function fail() error("nope") end
+    not_a_function = 5
+    )PREFIX");
+}
+}
+
+TEST_CASE("executor_test/submit", "executor submit test") {
+  executor pool(3, &init);
+  CHECK(pool.size() == 3);
+
+  std::vector<std::future<result<int>>> futures;
+  for (int i = 0; i < 200; i++) {
+    futures.push_back(pool.submit<int>("square", i));
+  }
+  for (int i = 0; i < 200; i++) {
+    CHECK(futures[i].get().value() == i * i);
+  }
+  CHECK(pool.submit<std::string>("label", std::string("job"), 7)
+            .get()
+            .value() == "job7");
+
+  auto failed = pool.submit<void>("fail").get();
+  CHECK(!failed.success());
+  CHECK(failed.error().error_type() == error::type::runtime);
+
+  auto thrown = pool.submit<int>("not_a_function");
+  CHECK_THROWS_AS(thrown.get(), exception);
+
+  pool.wait();
+  auto stats = pool.get_stats();
+  CHECK(stats.submitted == 203);
+  CHECK(stats.completed == 203);
+  CHECK(stats.failed == 1);
+}
+
+TEST_CASE("executor_test/post", "executor callback test") {
+  std::atomic<int> sum { 0 };
+  {
+    executor pool(2, &init);
+    for (int i = 1; i <= 100; i++) {
+      pool.post<int>([&sum](result<int> r) { sum += r.value(); }, "square", i);
+    }
+  }
+  CHECK(sum.load() == 338350);
+}
+
+TEST_CASE("executor_test/edges", "executor zero workers and wait from a job test") {
+  executor pool(0, &init);
+  CHECK(pool.size() == 1);
+  CHECK(pool.submit<int>("square", 4).get().value() == 16);
+
+  std::atomic<bool> threw { false };
+  pool.post<int>([&pool, &threw](result<int>) {
+    try {
+      pool.wait();
+    } catch (const exception&) {
+      threw = true;
+    }
+  }, "square", 2);
+  pool.wait();
+  CHECK(threw.load());
+}
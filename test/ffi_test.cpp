@@ -0,0 +1,50 @@
+#include "catch.hpp"
+#include "luapp11/lua.hpp"
+
+#include <cstring>
+
+using namespace luapp11;
+
+namespace {
+int multiply(int a, int b) { return a * b; }
+
+double half(double d) { return d / 2; }
+
+unsigned length(const char* str) { return strlen(str); }
+
+int first(char* str) { return str[0]; }
+}
+
+TEST_CASE("ffi_test/types", "ffi type declaration test") {
+  typedef ffi_fn<decltype(&multiply), &multiply> multiply_fn;
+  typedef ffi_fn<decltype(&half), &half> half_fn;
+  typedef ffi_fn<decltype(&length), &length> length_fn;
+  CHECK(multiply_fn::pointer_type() == "int32_t (*)(int32_t, int32_t)");
+  CHECK(half_fn::declaration("half") == "double half(double);");
+  CHECK(length_fn::pointer_type() == "uint32_t (*)(const char *)");
+  CHECK((ffi_fn<decltype(&first), &first>::pointer_type() == "int32_t (*)(char *)"));
+}
+
+TEST_CASE("ffi_test/call", "ffi bound function call test") {
+  global["multiply"] = LUAPP11_FFI_FN(multiply);
+  global["half"] = LUAPP11_FFI_FN(half);
+  global["length"] = LUAPP11_FFI_FN(length);
+
+  global["r"].do_chunk("return type(multiply)");
+  CHECK(global["r"] == std::string("cdata"));
+
+  global["r"].do_chunk(
+      "local s = 0 for i = 1, 1000 do s = s + multiply(i, 2) end return s");
+  CHECK(global["r"] == 1001000);
+
+  global["r"].do_chunk("return half(5)");
+  CHECK(global["r"] == 2.5);
+
+  global["r"].do_chunk("return length('hello')");
+  CHECK(global["r"] == 5);
+
+  global["first"] = LUAPP11_FFI_FN(first);
+  CHECK(!global["r"].do_chunk(
+      "local b = require('ffi').new('char[?]', 2, 'A') return first(b)"));
+  CHECK(global["r"] == 65);
+}
@@ -0,0 +1,91 @@
+#include "catch.hpp"
+#include "luapp11/lua.hpp"
+
+using namespace luapp11;
+
+namespace {
+int subtract(int a, int b) { return a - b; }
+
+std::string greet(std::string name, bool loud) {
+  return loud ? "HELLO " + name : "hello " + name;
+}
+
+double thrower(double) { throw std::runtime_error("thrower threw"); }
+}
+
+TEST_CASE("fn_test/call", "statically bound function test") {
+  global["subtract"] = fn<decltype(&subtract), &subtract>();
+  auto func = global["func"];
+  func.do_chunk(
+      R"PREFIX(
+    return function (i)
+      return subtract(i, 5)
+    end
+    )PREFIX");
+  auto result = func.invoke<int>(7);
+  CHECK(result.success());
+  CHECK(result.value() == 2);
+
+  global["greet"] = LUAPP11_FN(greet);
+  auto func2 = global["func2"];
+  func2.do_chunk(
+      R"PREFIX(
+    return function (name)
+      return greet(name, true) .. "/" .. greet(name, false)
+    end
+    )PREFIX");
+  auto result2 = func2.invoke<std::string>("bob");
+  CHECK(result2.success());
+  CHECK(result2.value() == "HELLO bob/hello bob");
+}
+
+TEST_CASE("fn_test/errors", "statically bound function error test") {
+  global["subtract"] = LUAPP11_FN(subtract);
+  global["thrower"] = LUAPP11_FN(thrower);
+  global["greet"] = LUAPP11_FN(greet);
+
+  CHECK((bool) global["r"].do_chunk("return subtract(1)"));
+  CHECK((bool) global["r"].do_chunk("return greet({}, true)"));
+  CHECK((bool) global["r"].do_chunk("return subtract('abc', 1)"));
+  CHECK((bool) global["r"].do_chunk("return subtract(1, {})"));
+  CHECK(!global["r"].do_chunk("return subtract('7', 2)"));
+  CHECK(global["r"] == 5);
+
+  auto err = global["r"].do_chunk("return thrower(1)");
+  CHECK((bool) err);
+  CHECK(err.lua_message() == "thrower threw");
+}
+
+namespace {
+void nothing(int) {}
+
+std::tuple<int, std::string> divide(int a, int b) {
+  if (b == 0) {
+    return std::make_tuple(0, std::string("divide by zero"));
+  }
+  return std::make_tuple(a / b, std::string());
+}
+
+std::pair<bool, double> halve(double d) { return std::make_pair(true, d / 2); }
+}
+
+TEST_CASE("fn_test/returns", "multiple and void return test") {
+  global["nothing"] = LUAPP11_FN(nothing);
+  global["divide"] = LUAPP11_FN(divide);
+  global["halve"] = &halve;
+  global["swap"] = [](int a, std::string b) { return std::make_tuple(b, a); };
+
+  global["r"].do_chunk("return select('#', nothing(1))");
+  CHECK(global["r"] == 0);
+
+  global["r"].do_chunk("local v, err = divide(7, 2) return v .. '|' .. err");
+  CHECK(global["r"] == std::string("3|"));
+  global["r"].do_chunk("local v, err = divide(7, 0) return v .. '|' .. err");
+  CHECK(global["r"] == std::string("0|divide by zero"));
+
+  global["r"].do_chunk("local ok, v = halve(5) return ok and v");
+  CHECK(global["r"] == 2.5);
+
+  global["r"].do_chunk("local a, b = swap(1, 'x') return a .. b");
+  CHECK(global["r"] == std::string("x1"));
+}
@@ -0,0 +1,53 @@
+#include "catch.hpp"
+#include "luapp11/lua.hpp"
+
+using namespace luapp11;
+
+TEST_CASE("function_test/call", "prepared function call test") {
+  global["func"].do_chunk(
+      R"PREFIX(
+    return function (i, s)
+      return i + 5, s .. "!"
+    end
+    )PREFIX");
+
+  function<int(int, std::string)> func(global["func"]);
+  for (int i = 0; i < 10; i++) {
+    auto result = func(i, "foo");
+    CHECK(result.success());
+    CHECK(result.value() == i + 5);
+  }
+
+  function<std::tuple<int, std::string>(int, std::string)> func2(
+      global["func"]);
+  std::string str = "bar";
+  auto result2 = func2(1, str);
+  CHECK(result2.success());
+  CHECK(result2.value() == std::make_tuple(6, "bar!"));
+
+  global["func"] = val::nil();
+  auto copy = func;
+  CHECK(copy(1, "x").value() == 6);
+}
+
+TEST_CASE("function_test/errors", "prepared function error test") {
+  CHECK_THROWS(function<void()> { global["dne"] });
+
+  global["fails"].do_chunk("return function () error('nope') end");
+  function<void()> fails(global["fails"]);
+  auto result = fails();
+  CHECK(!result.success());
+  CHECK(result.error().lua_message().find("nope") != std::string::npos);
+}
+
+TEST_CASE("function_test/closed_state", "function outliving its state test") {
+  std::unique_ptr<function<int(int)>> func;
+  {
+    state s;
+    s.do_chunk("function add_one(i) return i + 1 end");
+    func.reset(new function<int(int)>(s["add_one"]));
+    CHECK((*func)(1).value() == 2);
+  }
+  CHECK_THROWS((*func)(1));
+  func.reset();
+}
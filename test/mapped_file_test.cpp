@@ -0,0 +1,45 @@
+#include "catch.hpp"
+#include "luapp11/lua.hpp"
+
+#include <cstdio>
+#include <fstream>
+
+using namespace luapp11;
+
+namespace {
+void write(const std::string& path, const std::string& contents) {
+  std::ofstream(path, std::ios::binary) << contents;
+}
+}
+
+TEST_CASE("mapped_file_test/shebang", "do_file skips #! line test") {
+  write("mapped_file_test.lua", "#!/usr/bin/env luajit\nreturn 7\n");
+  CHECK(!global["r"].do_file("mapped_file_test.lua"));
+  CHECK(global["r"].get<int>() == 7);
+
+  // Line numbers still count the #! line.
+  write("mapped_file_test.lua", "#!/usr/bin/env luajit\n\nerror('here')\n");
+  auto err = global["r"].do_file("mapped_file_test.lua");
+  CHECK(err.error_type() == error::type::runtime);
+  CHECK(err.lua_message() == "mapped_file_test.lua:3: here");
+
+  std::string bytecode;
+  write("mapped_file_test.lua", "return 8");
+  CHECK(!dump_file("mapped_file_test.lua", bytecode));
+  write("mapped_file_test.lua", "#!/usr/bin/env luajit\n" + bytecode);
+  CHECK(!global["r"].do_file("mapped_file_test.lua"));
+  CHECK(global["r"].get<int>() == 8);
+  std::remove("mapped_file_test.lua");
+}
+
+TEST_CASE("mapped_file_test/empty", "do_file empty and missing file test") {
+  global["r"] = 1;
+  write("mapped_file_test.lua", "");
+  CHECK(!global["r"].do_file("mapped_file_test.lua"));
+  CHECK(!global["r"].is<int>());
+  std::remove("mapped_file_test.lua");
+
+  auto err = global["r"].do_file("mapped_file_test.lua");
+  CHECK(err.error_type() == error::type::file);
+  CHECK(err.lua_message() == "cannot open mapped_file_test.lua");
+}
@@ -0,0 +1,116 @@
+#include "catch.hpp"
+#include "luapp11/lua.hpp"
+
+#include <functional>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace luapp11;
+
+namespace {
+void init(state& s) {
+  s.do_chunk("function square(x) return x * x end");
+  s.do_chunk("function sum(items) local t = 0 for i = 1, #items do t = t + "
+             "items[i] end return t end");
+  s.do_chunk("function shout(s) return s:upper() end");
+  s.do_chunk("function fail(x) if x == 7 then error('seven') end return x end");
+  s.do_chunk("function holes(x) if x ~= 3 then return x end end");
+  s.do_chunk("function nothing(items) end");
+}
+}
+
+TEST_CASE("parallel_test/map", "parallel map test") {
+  state_pool pool(3, &init);
+  std::vector<int> in;
+  for (int i = 0; i < 100; i++) {
+    in.push_back(i);
+  }
+  std::vector<int> out;
+  auto r = parallel_map<int>(pool, "square", in.begin(), in.end(),
+                             std::back_inserter(out));
+  CHECK((bool)r);
+  REQUIRE(out.size() == 100);
+  bool ordered = true;
+  for (int i = 0; i < 100; i++) {
+    ordered = ordered && out[i] == i * i;
+  }
+  CHECK(ordered);
+  CHECK(pool.get_stats().checkouts == 3);
+
+  std::vector<std::string> words { "a", "bc" };
+  std::vector<std::string> loud;
+  parallel_map<std::string>(pool, "shout", words.begin(), words.end(),
+                            std::back_inserter(loud));
+  REQUIRE(loud.size() == 2);
+  CHECK(loud[0] == "A");
+  CHECK(loud[1] == "BC");
+
+  std::vector<int> none;
+  auto empty = parallel_map<int>(pool, "square", in.begin(), in.begin(),
+                                 std::back_inserter(none));
+  CHECK((bool)empty);
+  CHECK(none.empty());
+}
+
+TEST_CASE("parallel_test/reduce", "parallel reduce test") {
+  state_pool pool(4, &init);
+  std::vector<double> in;
+  for (int i = 1; i <= 1000; i++) {
+    in.push_back(i);
+  }
+  auto r = parallel_reduce(pool, "sum", in.begin(), in.end(), 0.0,
+                           std::plus<double>());
+  CHECK(r.value() == 500500);
+
+  std::vector<double> three { 1, 2, 3 };
+  auto few = parallel_reduce(pool, "sum", three.begin(), three.end(), 10.0,
+                             std::plus<double>());
+  CHECK(few.value() == 16);
+
+  auto empty = parallel_reduce(pool, "sum", in.begin(), in.begin(), 5.0,
+                               std::plus<double>());
+  CHECK(empty.value() == 5);
+}
+
+TEST_CASE("parallel_test/errors", "parallel error test") {
+  state_pool pool(2, &init);
+  std::vector<int> in { 1, 2, 7, 8 };
+  std::vector<int> out;
+  auto r = parallel_map<int>(pool, "fail", in.begin(), in.end(),
+                             std::back_inserter(out));
+  CHECK(!r);
+  CHECK(out.empty());
+  CHECK(pool.get_stats().in_use == 0);
+
+  CHECK_THROWS(parallel_map<int>(pool, "missing", in.begin(), in.end(),
+                                 std::back_inserter(out)));
+  CHECK(pool.get_stats().in_use == 0);
+
+  // nil isn't quietly turned into 0.
+  std::vector<int> holes { 1, 2, 3, 4 };
+  auto nil = parallel_map<int>(pool, "holes", holes.begin(), holes.end(),
+                              std::back_inserter(out));
+  REQUIRE(!nil);
+  CHECK(nil.error().lua_message() == "Parallel function returned nil.");
+  CHECK(out.empty());
+  std::vector<val> vals;
+  CHECK((bool)parallel_map<val>(pool, "holes", holes.begin(), holes.end(),
+                                std::back_inserter(vals)));
+  REQUIRE(vals.size() == 4);
+  CHECK(vals[2] == val::nil());
+  CHECK(!parallel_reduce(pool, "nothing", holes.begin(), holes.end(), 0,
+                         std::plus<int>()));
+  CHECK(pool.get_stats().in_use == 0);
+}
+
+TEST_CASE("parallel_test/held", "parallel call while holding a lease test") {
+  state_pool pool(1, &init);
+  std::vector<int> in { 1, 2, 3 };
+  auto held = pool.checkout();
+  std::vector<int> out;
+  CHECK((bool)parallel_map<int>(pool, "square", in.begin(), in.end(),
+                                std::back_inserter(out)));
+  CHECK(out == std::vector<int>({ 1, 4, 9 }));
+  CHECK(pool.get_stats().in_use == 1);
+}
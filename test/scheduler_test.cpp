@@ -0,0 +1,154 @@
+#include "catch.hpp"
+#include "luapp11/lua.hpp"
+
+using namespace luapp11;
+
+TEST_CASE("scheduler_test/order", "scheduler deadline and priority test") {
+  std::vector<std::string> log;
+  global["log"] = [&log](std::string s) { log.push_back(s); };
+  global["task"].do_chunk(
+      R"PREFIX(
+    return function (name)
+      log(name .. "1")
+      coroutine.yield()
+      log(name .. "2")
+    end
+    )PREFIX");
+
+  auto now = scheduler::clock::now();
+  scheduler s;
+  s.spawn(global["task"], "none");
+  s.spawn(now + std::chrono::seconds(2), 0, global["task"], "late");
+  s.spawn(now + std::chrono::seconds(1), 0, global["task"], "low");
+  s.spawn(now + std::chrono::seconds(1), 5, global["task"], "high");
+  CHECK(s.get_stats().ready == 4);
+
+  CHECK(s.run_once() == 4);
+  CHECK(s.run_once() == 4);
+  CHECK(s.empty());
+  CHECK(log == std::vector<std::string>({
+    "high1", "low1", "late1", "none1", "high2", "low2", "late2", "none2"
+  }));
+
+  auto stats = s.get_stats();
+  CHECK(stats.completed == 4);
+  CHECK(stats.resumes == 8);
+  CHECK(stats.late == 0);
+}
+
+TEST_CASE("scheduler_test/park", "scheduler timer and future test") {
+  std::promise<void> promise;
+  scheduler s;
+  global["fetch"] = [&s, &promise]() {
+    return s.await(promise.get_future().share());
+  };
+  global["sleeper"].do_chunk(
+      "return function () coroutine.yield(0.01) return 1 end");
+  global["waiter"].do_chunk(
+      "return function () coroutine.yield(fetch()) return 2 end");
+  global["failer"].do_chunk(
+      "return function () coroutine.yield() error('oops') end");
+
+  int errors = 0;
+  s.on_error([&errors](const error & e) { errors++; });
+  s.spawn(global["sleeper"]);
+  s.spawn(global["waiter"]);
+  s.spawn(scheduler::clock::now() - std::chrono::seconds(1), 0,
+          global["failer"]);
+
+  s.run_once();
+  auto stats = s.get_stats();
+  CHECK(stats.sleeping == 1);
+  CHECK(stats.waiting == 1);
+  CHECK(stats.ready == 1);
+  CHECK(stats.late == 1);
+
+  s.run_once();
+  CHECK(errors == 1);
+  CHECK(s.get_stats().failed == 1);
+  CHECK(s.run_once() == 0);
+
+  promise.set_value();
+  s.run();
+  CHECK(s.empty());
+  CHECK(s.get_stats().completed == 2);
+}
+
+TEST_CASE("scheduler_test/slice", "scheduler preemption test") {
+  std::vector<std::string> log;
+  global["log"] = [&log](std::string s) { log.push_back(s); };
+  global["hog"].do_chunk(
+      R"PREFIX(
+    return function ()
+      local s = 0
+      for i = 1, 1000000 do s = s + i end
+      log("hog")
+    end
+    )PREFIX");
+  global["quick"].do_chunk("return function () log('quick') end");
+
+  scheduler s;
+  s.set_slice(1000);
+  s.spawn(global["hog"]);
+  s.spawn(global["quick"]);
+  s.run();
+  CHECK(log == std::vector<std::string>({ "quick", "hog" }));
+  CHECK(s.get_stats().resumes > 10);
+}
+
+TEST_CASE("scheduler_test/yields", "scheduler yielded values and tokens test") {
+  std::promise<void> promise;
+  auto future = promise.get_future().share();
+  scheduler s;
+  global["take"] = [&s, &future]() { return s.await(future); };
+  global["tabler"].do_chunk(
+      "return function () coroutine.yield({ 1, 2 }) coroutine.yield(print) return 1 end");
+  global["taker"].do_chunk(
+      "return function () local t = take() coroutine.yield() end");
+
+  int errors = 0;
+  s.on_error([&errors](const error&) { errors++; });
+  s.spawn(global["tabler"]);
+  s.spawn(global["taker"]);
+  s.run_once();
+  CHECK(s.get_stats().ready == 2);
+  CHECK(s.get_stats().tokens == 1);
+
+  s.run();
+  CHECK(errors == 0);
+  CHECK(s.get_stats().completed == 2);
+  CHECK(s.get_stats().tokens == 0);
+}
+
+TEST_CASE("scheduler_test/bad_delays", "scheduler odd delays and loose tokens test") {
+  scheduler s;
+  global["odd"].do_chunk(
+      "return function () coroutine.yield(0 / 0) coroutine.yield(1 / 0) "
+      "coroutine.yield(-1 / 0) coroutine.yield(-5) coroutine.yield(1e300) end");
+  s.spawn(global["odd"]);
+  for (int i = 0; i < 5; i++) {
+    CHECK(s.run_once() == 1);
+    CHECK(s.get_stats().sleeping == 0);
+  }
+  s.run_once();
+  CHECK(s.empty());
+  CHECK(s.get_stats().completed == 1);
+
+  // Tokens taken outside any task go once their futures are ready.
+  std::promise<int> promise;
+  auto token = s.await(promise.get_future().share());
+  s.run_once();
+  CHECK(s.get_stats().tokens == 1);
+  promise.set_value(1);
+  s.run_once();
+  CHECK(s.get_stats().tokens == 0);
+
+  // Yielding one after it's dropped just runs the task again.
+  global["token"] = token;
+  global["late"].do_chunk("return function () coroutine.yield(token) end");
+  s.spawn(global["late"]);
+  s.run_once();
+  CHECK(s.get_stats().ready == 1);
+  s.run();
+  CHECK(s.get_stats().completed == 2);
+}
@@ -0,0 +1,80 @@
+#include "catch.hpp"
+#include "luapp11/lua.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace luapp11;
+
+TEST_CASE("state_pool_test/checkout", "state pool checkout test") {
+  int inits = 0;
+  state_pool pool(2, [&inits](state& s) {
+    s["id"] = inits++;
+    s.do_chunk("function twice(x) return x * 2 end");
+  });
+  CHECK(pool.size() == 2);
+  CHECK(inits == 2);
+
+  {
+    auto a = pool.checkout();
+    auto b = pool.checkout();
+    CHECK(a.index() != b.index());
+    CHECK(a["twice"].invoke<int>(21).value() == 42);
+    CHECK((*b)["id"].get<int>() == (int)b.index());
+    CHECK(!pool.try_checkout());
+    CHECK(pool.get_stats().in_use == 2);
+  }
+  auto stats = pool.get_stats();
+  CHECK(stats.in_use == 0);
+  CHECK(stats.checkouts == 2);
+  CHECK(stats.utilization > 0);
+  CHECK(stats.utilization <= 1);
+  CHECK((bool)pool.try_checkout());
+}
+
+TEST_CASE("state_pool_test/affinity", "state pool affinity test") {
+  state_pool pool(4);
+  size_t first = pool.checkout().index();
+  for (int i = 0; i < 10; i++) {
+    CHECK(pool.checkout().index() == first);
+  }
+  CHECK(pool.get_stats().affinity_hits == 10);
+
+  state_pool loose(4, false);
+  loose.checkout();
+  loose.checkout();
+  CHECK(loose.get_stats().affinity_hits == 0);
+}
+
+TEST_CASE("state_pool_test/threads", "state pool many threads test") {
+  state_pool pool(2, [](state& s) { s["calls"] = 0; });
+  std::atomic<int> concurrent { 0 };
+  std::atomic<int> most { 0 };
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 6; t++) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < 50; i++) {
+        auto s = pool.checkout();
+        int now = ++concurrent;
+        int seen = most;
+        while (now > seen && !most.compare_exchange_weak(seen, now)) {}
+        s->do_chunk("calls = calls + 1");
+        std::this_thread::yield();
+        --concurrent;
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  CHECK(most.load() <= 2);
+  auto a = pool.checkout();
+  auto b = pool.checkout();
+  int calls = a["calls"].get<int>() + b["calls"].get<int>();
+  CHECK(calls == 300);
+  auto stats = pool.get_stats();
+  CHECK(stats.checkouts == 302);
+  CHECK(stats.in_use == 2);
+  CHECK(stats.total_wait >= stats.max_wait);
+}
@@ -0,0 +1,94 @@
+#include "catch.hpp"
+#include "luapp11/lua.hpp"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace luapp11;
+
+namespace {
+// Runs before main, in whatever order relative to other translation units.
+int from_static_init = [] {
+  global["state_test_static"] = 7;
+  return global["state_test_static"].get<int>();
+}();
+}
+
+TEST_CASE("state_test/independent", "states are independent test") {
+  state a, b;
+  CHECK(!a.do_chunk("x = 1"));
+  CHECK(!b.do_chunk("x = 2"));
+  CHECK(a["x"].get<int>() == 1);
+  CHECK(b["x"].get<int>() == 2);
+  CHECK(!global["x"].is<int>());
+
+  a["t"] = { 1, 2, 3 };
+  CHECK(!a["n"].do_chunk("return #t"));
+  CHECK(a["n"].get<int>() == 3);
+  CHECK(!b["t"].is<int>());
+  CHECK(&chunk_cache::of(a) != &chunk_cache::of(b));
+
+  CHECK(!a.do_file("../test/lua/test.lua"));
+  CHECK(a.do_file("../test/lua/fail.lua").error_type() ==
+        error::type::syntax);
+}
+
+TEST_CASE("state_test/lifetime", "state closes on destruction test") {
+  auto captured = std::make_shared<int>(5);
+  {
+    state s;
+    s["f"] = [captured]() { return *captured; };
+    CHECK(s["f"].invoke<int>().value() == 5);
+    CHECK(captured.use_count() == 2);
+  }
+  CHECK(captured.use_count() == 1);
+}
+
+TEST_CASE("state_test/move", "state move test") {
+  state a;
+  a["x"] = 7;
+  auto x = a["x"];
+  state b(std::move(a));
+  CHECK(!a.lua());
+  CHECK(x.get<int>() == 7);
+  CHECK(b["x"].get<int>() == 7);
+
+  state c;
+  c = std::move(b);
+  CHECK(c["x"].get<int>() == 7);
+
+  std::vector<state> states(3);
+  states.emplace_back();
+  CHECK(states.size() == 4);
+}
+
+TEST_CASE("state_test/threads", "one state per thread test") {
+  std::vector<int> sums(4);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([t, &sums]() {
+      state s;
+      s["n"] = t + 1;
+      s["sum"].do_chunk("local s = 0 for i = 1, n * 1000 do s = s + i end "
+                        "return s");
+      sums[t] = s["sum"].get<int>();
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  for (int t = 0; t < 4; t++) {
+    int n = (t + 1) * 1000;
+    CHECK(sums[t] == n * (n + 1) / 2);
+  }
+}
+
+TEST_CASE("state_test/global", "global state test") {
+  CHECK(from_static_init == 7);
+  CHECK(global["state_test_static"] == 7);
+  const state& s = global;
+  CHECK(s.lua() == global.lua());
+  CHECK(!do_chunk("state_test_global = 1"));
+  CHECK(s["state_test_global"] == 1);
+}
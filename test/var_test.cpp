@@ -246,6 +246,67 @@ TEST_CASE("var_test/invoke", "invoke test") {
   CHECK(result2.value() == std::make_tuple(12, "foo"));
 }
 
+TEST_CASE("var_test/invoke_each", "invoke_each test") {
+  auto func = global["func"];
+  func.do_chunk(
+      R"PREFIX(
+    return function (i)
+      if i < 0 then error("negative") end
+      return i * 2
+    end
+    )PREFIX");
+  std::vector<int> in({ 1, 2, 3, 4 });
+  std::vector<int> out;
+  auto result = func.invoke_each<int>(in.begin(), in.end(),
+                                      std::back_inserter(out));
+  CHECK(result.success());
+  CHECK(out == std::vector<int>({ 2, 4, 6, 8 }));
+
+  in.push_back(-1);
+  in.push_back(5);
+  out.clear();
+  result = func.invoke_each<int>(in.begin(), in.end(),
+                                 std::back_inserter(out));
+  CHECK(!result.success());
+  CHECK(out.size() == 4);
+  CHECK_THROWS(global["dne"].invoke_each<int>(in.begin(), in.end(),
+                                              std::back_inserter(out)));
+
+  auto record = global["record"];
+  record.do_chunk(
+      R"PREFIX(
+    total = 0
+    return function (i)
+      if i < 0 then error("negative") end
+      total = total + i
+    end
+    )PREFIX");
+  in = { 1, 2, 3 };
+  result = record.invoke_each<void>(in.begin(), in.end());
+  CHECK(result.success());
+  CHECK(global["total"] == 6);
+  in = { 4, -1, 5 };
+  result = record.invoke_each<void>(in.begin(), in.end());
+  CHECK(!result.success());
+  CHECK(global["total"] == 10);
+}
+
+TEST_CASE("var_test/result_assign", "result assignment between values and errors test") {
+  global["twice"].do_chunk("return function (i) return i * 2 end");
+  global["fails"].do_chunk("return function () error('no') end");
+  auto r = global["twice"].invoke<int>(2);
+  auto failed = global["fails"].invoke<int>();
+  r = failed;
+  CHECK(!r.success());
+  CHECK(r.error().lua_message() == failed.error().lua_message());
+  r = failed;
+  CHECK(!r.success());
+  r = global["twice"].invoke<int>(5);
+  CHECK(r.value() == 10);
+  r = global["twice"].invoke<int>(6);
+  CHECK(r.value() == 12);
+}
+
 int add(int a, int b) { return a + b; }
 
 TEST_CASE("var_test/cfunc", "Calling c functions from lua test") {
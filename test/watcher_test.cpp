@@ -0,0 +1,90 @@
+#include "catch.hpp"
+#include "luapp11/lua.hpp"
+
+#include <cstdio>
+#include <fstream>
+
+#ifdef __linux__
+
+using namespace luapp11;
+
+namespace {
+void write(const std::string& path, const std::string& contents) {
+  std::ofstream(path, std::ios::binary) << contents;
+}
+}
+
+TEST_CASE("watcher_test/reload", "watcher reload test") {
+  write("watcher_test_rules.lua",
+        "return { version = 1, old = true, check = function () return 1 end }");
+  watcher w(global);
+  w.watch("rules", "watcher_test_rules.lua");
+  CHECK(w.poll().empty());
+
+  global["rules_mod"].do_chunk(
+      "package.loaded.rules = dofile('watcher_test_rules.lua') "
+      "return package.loaded.rules");
+  CHECK(global["rules_mod"]["version"].get<int>() == 1);
+
+  write("watcher_test_rules.lua",
+        "return { version = 2, check = function () return 2 end }");
+  auto reloads = w.poll();
+  REQUIRE(reloads.size() == 1);
+  CHECK(reloads[0].module == "rules");
+  CHECK(!reloads[0].error);
+  CHECK(reloads[0].compile_time > watcher::clock::duration::zero());
+
+  // The table the c++ side held on to sees the new module.
+  CHECK(global["rules_mod"]["version"].get<int>() == 2);
+  CHECK(!global["rules_mod"]["old"].is<bool>());
+  CHECK(global["rules_mod"]["check"].invoke<int>().value() == 2);
+  CHECK(w.poll().empty());
+
+  // Replaced by a rename, like many editors save.
+  write("watcher_test_rules.tmp", "return { version = 3 }");
+  std::rename("watcher_test_rules.tmp", "watcher_test_rules.lua");
+  CHECK(w.poll().size() == 1);
+  CHECK(global["rules_mod"]["version"].get<int>() == 3);
+
+  // A broken edit leaves the old module in place.
+  write("watcher_test_rules.lua", "return {");
+  reloads = w.poll();
+  REQUIRE(reloads.size() == 1);
+  CHECK(reloads[0].error.error_type() == error::type::syntax);
+  CHECK(global["rules_mod"]["version"].get<int>() == 3);
+  CHECK(w.reloads() == 3);
+  CHECK(w.failures() == 1);
+  std::remove("watcher_test_rules.lua");
+}
+
+TEST_CASE("watcher_test/no_package", "watcher without the package global test") {
+  write("watcher_test_bare.lua", "return { version = 1 }");
+  state s;
+  watcher w(s);
+  w.watch("bare", "watcher_test_bare.lua");
+  CHECK(!s["bare"].do_chunk("local m = dofile('watcher_test_bare.lua') "
+                                 "package.loaded.bare = m package = nil return m"));
+
+  // require keeps loaded modules in the registry, which is still there.
+  write("watcher_test_bare.lua", "return { version = 2 }");
+  CHECK(w.poll().size() == 1);
+  CHECK(s["bare"]["version"].get<int>() == 2);
+
+  // Without even that, nothing counts as required.
+  CHECK(!s.do_chunk("debug.getregistry()._LOADED = nil"));
+  write("watcher_test_bare.lua", "return { version = 3 }");
+  CHECK(w.poll().empty());
+  std::remove("watcher_test_bare.lua");
+}
+
+TEST_CASE("watcher_test/unrequired", "watcher skips modules not required test") {
+  write("watcher_test_lazy.lua", "lazy_ran = true return {}");
+  watcher w(global);
+  w.watch("lazy", "watcher_test_lazy.lua");
+  write("watcher_test_lazy.lua", "lazy_ran = true return { 1 }");
+  CHECK(w.poll().empty());
+  CHECK(!global["lazy_ran"].is<bool>());
+  std::remove("watcher_test_lazy.lua");
+}
+
+#endif